@@ -0,0 +1,527 @@
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+enum class Opcode {
+    add = 1,
+    mul = 2,
+    input = 3,
+    output = 4,
+    jump_true = 5,
+    jump_false = 6,
+    less_than = 7,
+    equals = 8,
+    relative_base = 9,
+    halt = 99,
+};
+
+enum class ParamMode {
+    position = 0,
+    immediate = 1,
+    relative = 2,
+};
+
+typedef long code;
+
+/**
+ * Raised when the program touches an address outside of its memory, i.e. not
+ * in [0, 2^31).
+ */
+class MemoryFault : public std::out_of_range {
+  public:
+    code address;
+    MemoryFault(code address) : std::out_of_range(std::format("memory fault at address {}", address)), address(address) {};
+};
+
+/**
+ * Memory is one anonymous mapping, zero-filled on demand by the kernel, that
+ * covers addresses [0, capacity). A write past it moves the mapping to a
+ * larger one with mremap, which carries the page tables over, so nothing is
+ * copied and untouched pages stay uncommitted. Reads and writes inside the
+ * mapping are plain loads and stores behind one unsigned compare, which also
+ * turns away negative addresses; reads past it are zeroes.
+ *
+ * This class is pasted verbatim into every tool that keeps Intcode memory in
+ * a mapping; keep the copies identical.
+ */
+class Program {
+  private:
+    // Smallest mapping, so that most programs never grow.
+    static constexpr std::size_t MIN_CAPACITY = std::size_t{1} << 16;
+    // Below this many bytes, clearing memory is cheaper than a madvise call.
+    static constexpr std::ptrdiff_t DISCARD_BYTES = 64 << 10;
+
+    code *memory = nullptr;
+    // Words mapped at `memory`, a power of two.
+    std::size_t capacity = 0;
+    // One past the highest address written, so copies know what to clone.
+    std::size_t extent = 0;
+
+    static std::size_t capacity_for(std::size_t words) {
+        return std::max(MIN_CAPACITY, std::bit_ceil(words));
+    }
+    [[gnu::cold]] code read_outside(code index) const {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        return 0;
+    }
+    [[gnu::cold]] void grow(code index) {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        reserve(index + 1);
+    }
+
+  public:
+    // Addresses are [0, WORDS).
+    static constexpr std::size_t WORDS = std::size_t{1} << 31;
+
+    /**
+     * A program of `extent` zero words.
+     */
+    explicit Program(std::size_t extent) : capacity(capacity_for(extent)), extent(extent) {
+        auto region = mmap(nullptr, capacity * sizeof(code), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping intcode memory");
+        memory = static_cast<code *>(region);
+    }
+    Program(const std::vector<code> &image) : Program(image.size()) {
+        std::memcpy(memory, image.data(), image.size() * sizeof(code));
+    }
+    static Program parse(std::istream &input_stream) {
+        std::vector<code> program{};
+        for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
+            auto opcode = std::stol(opcode_s);
+            program.push_back(opcode);
+        }
+        return Program(program);
+    }
+    Program(const Program &other) : Program(other.extent) {
+        std::memcpy(memory, other.memory, extent * sizeof(code));
+    }
+    Program(Program &&other) noexcept : memory(other.memory), capacity(other.capacity), extent(other.extent) {
+        other.memory = nullptr;
+    }
+    Program &operator=(Program other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(capacity, other.capacity);
+        std::swap(extent, other.extent);
+        return *this;
+    }
+    ~Program() {
+        if (memory)
+            munmap(memory, capacity * sizeof(code));
+    }
+
+    code read(code index) const {
+        if (static_cast<uint64_t>(index) < capacity) [[likely]]
+            return memory[index];
+        return read_outside(index);
+    }
+    void write(code index, code value) {
+        if (static_cast<uint64_t>(index) >= capacity) [[unlikely]]
+            grow(index);
+        memory[index] = value;
+        extent = std::max(extent, static_cast<std::size_t>(index) + 1);
+    }
+
+    std::size_t size() const {
+        return extent;
+    }
+    code *data() {
+        return memory;
+    }
+    const code *data() const {
+        return memory;
+    }
+
+    /**
+     * Maps at least `words` words. Growing may move the mapping, which
+     * invalidates pointers from data().
+     */
+    void reserve(std::size_t words) {
+        if (words <= capacity)
+            return;
+        auto bigger = capacity_for(words);
+        auto region = mremap(memory, capacity * sizeof(code), bigger * sizeof(code), MREMAP_MAYMOVE);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "growing intcode memory");
+        memory = static_cast<code *>(region);
+        capacity = bigger;
+    }
+
+    /**
+     * Makes this program's memory equal to `image` again without remapping:
+     * the image is copied back in and whatever was written past its end is
+     * cleared.
+     */
+    void reset(const Program &image) {
+        reserve(image.extent);
+        std::memcpy(memory, image.memory, image.extent * sizeof(code));
+        if (extent > image.extent)
+            clear(image.extent, extent);
+        extent = image.extent;
+    }
+
+    /**
+     * Zeroes words [from, to). Short ranges are overwritten; in longer ones
+     * the whole pages are handed back to the kernel, so the cost follows the
+     * pages actually touched rather than the range: a run that wrote one word
+     * at a high address leaves gigabytes below it that were never faulted in,
+     * and writing zeroes over them would commit them all.
+     */
+    void clear(std::size_t from, std::size_t to) {
+        static const auto page_bytes = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<char *>(memory + from);
+        auto end = reinterpret_cast<char *>(memory + to);
+        auto first = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(begin) + page_bytes - 1) & ~(page_bytes - 1));
+        auto last = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(end) & ~(page_bytes - 1));
+        if (last - first < DISCARD_BYTES) {
+            std::memset(begin, 0, end - begin);
+            return;
+        }
+        std::memset(begin, 0, first - begin);
+        std::memset(last, 0, end - last);
+        if (madvise(first, last - first, MADV_DONTNEED) != 0)
+            throw std::system_error(errno, std::generic_category(), "discarding intcode memory");
+    }
+};
+
+class Instruction {
+  public:
+    Opcode opcode;
+    ParamMode mode1;
+    ParamMode mode2;
+    ParamMode mode3;
+    static Instruction parse(code x) {
+        return Instruction(Opcode(x % 100), ParamMode((x / 100) % 10), ParamMode((x / 1000) % 10), ParamMode((x / 10000) % 10));
+    };
+};
+
+enum class Stop { halted, needs_input, output_full };
+
+class Computer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+    code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return p.read(parameter);
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return p.read(relative_base + parameter);
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return parameter;
+            case ParamMode::relative:
+                return relative_base + parameter;
+            case ParamMode::immediate:
+                throw std::invalid_argument("write operands cannot be in immediate mode");
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+
+  public:
+    Computer(Program p) : p(std::move(p)) {};
+
+    /**
+     * Returns the computer to the state of a fresh Computer(image), reusing its
+     * memory mapping.
+     */
+    void reset(const Program &image) {
+        p.reset(image);
+        pc = 0;
+        relative_base = 0;
+        halted = false;
+    }
+    bool is_halted() const {
+        return halted;
+    }
+    // Outside run() too, an address out of range is a MemoryFault.
+    code peek(code address) const {
+        return p.read(address);
+    }
+    void poke(code address, code value) {
+        p.write(address, value);
+    }
+
+    /**
+     * Executes until the program halts, needs an input that `input` cannot
+     * supply, or `output` reaches `output_limit` values. Consumed inputs are
+     * popped and outputs are appended, so the caller can drain both between
+     * calls and keep memory bounded however long the program runs.
+     */
+    Stop run(std::deque<code> &input, std::vector<code> &output, std::size_t output_limit) {
+        assert(!halted);
+
+        while (true) {
+            auto in = Instruction::parse(p.read(pc));
+
+            switch (in.opcode) {
+                case Opcode::halt: {
+                    halted = true;
+                    return Stop::halted;
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 + arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 * arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty())
+                        return Stop::needs_input;
+                    auto arg1 = eval_write_operand(p.read(pc + 1), in.mode1);
+                    p.write(arg1, input.front());
+                    pc += 2;
+                    input.pop_front();
+                    break;
+                }
+                case Opcode::output: {
+                    if (output.size() >= output_limit)
+                        return Stop::output_full;
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    output.push_back(arg1);
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 != 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 == 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 < arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 == arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    relative_base += arg1;
+                    pc += 2;
+                    break;
+                }
+                default: {
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.read(pc)));
+                }
+            }
+        }
+    }
+};
+
+// Input vectors are read, run and written in chunks of this many lines; only
+// one chunk is held in memory at a time.
+const std::size_t CHUNK = 1 << 14;
+
+struct Options {
+    // When non-empty, vector element i is written to patch[i] before the run
+    // instead of being fed as an input (day02 style noun/verb).
+    std::vector<code> patch{};
+    // When set, the value at this address after the run is reported instead
+    // of the outputs.
+    std::optional<code> peek{};
+};
+
+std::vector<code> parse_codes(std::string_view line) {
+    std::vector<code> values{};
+    const char *p = line.data();
+    const char *end = line.data() + line.size();
+    while (p < end) {
+        if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            code x;
+            auto [next, ec] = std::from_chars(p, end, x);
+            if (ec != std::errc())
+                throw std::invalid_argument(std::format("bad number in \"{}\"", line));
+            values.push_back(x);
+            p = next;
+        } else {
+            p++;
+        }
+    }
+    return values;
+}
+
+/**
+ * Runs one input vector on a reset computer and renders its result line.
+ */
+void run_vector(Computer &computer, const Program &image, const Options &options, const std::string &line, std::string &result) {
+    result.clear();
+    std::deque<code> input{};
+    std::vector<code> output{};
+    try {
+        auto values = parse_codes(line);
+        computer.reset(image);
+        if (options.patch.empty()) {
+            input.assign(values.begin(), values.end());
+        } else {
+            if (values.size() != options.patch.size())
+                throw std::invalid_argument(std::format("expected {} values, got {}", options.patch.size(), values.size()));
+            for (std::size_t i = 0; i < values.size(); i++)
+                computer.poke(options.patch[i], values[i]);
+        }
+        auto stop = computer.run(input, output, SIZE_MAX);
+        if (options.peek) {
+            result = std::to_string(computer.peek(*options.peek));
+        } else {
+            for (std::size_t i = 0; i < output.size(); i++) {
+                if (i)
+                    result += ',';
+                result += std::to_string(output[i]);
+            }
+        }
+        if (stop == Stop::needs_input)
+            result += " (awaiting input)";
+    } catch (std::exception &e) {
+        result = std::format("error: {}", e.what());
+    }
+}
+
+/**
+ * Usage: batch [--threads N] [--patch A,B,...] [--peek ADDR] PROGRAM < VECTORS
+ *
+ * Runs PROGRAM once per line of stdin, using the numbers on the line as the
+ * inputs, and prints one line of comma-separated outputs per input line, in
+ * input order. Lines are spread over a pool of threads, each of which resets a
+ * single Computer between runs instead of constructing a new one.
+ */
+int main(int argc, char **argv) {
+    std::ios::sync_with_stdio(false);
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    Options options{};
+    std::string path{};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--patch" && i + 1 < argc) {
+            options.patch = parse_codes(argv[++i]);
+        } else if (arg == "--peek" && i + 1 < argc) {
+            options.peek = std::stol(argv[++i]);
+        } else if (path.empty() && !arg.starts_with("--")) {
+            path = arg;
+        } else {
+            std::cerr << std::format("unknown argument {}", arg) << std::endl;
+            return 2;
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "usage: batch [--threads N] [--patch A,B,...] [--peek ADDR] PROGRAM < VECTORS" << std::endl;
+        return 2;
+    }
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << std::format("cannot open {}", path) << std::endl;
+        return 2;
+    }
+    const auto image = Program::parse(file);
+
+    std::vector<std::string> lines(CHUNK);
+    std::vector<std::string> results(CHUNK);
+    std::size_t count = 0;
+    std::atomic<std::size_t> next = 0;
+    bool done = false;
+
+    // The main thread is worker 0 and also reads and writes between chunks;
+    // the barrier separates the I/O phase from the compute phase.
+    std::barrier sync(threads);
+    auto work = [&](Computer &computer) {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < count;)
+            run_vector(computer, image, options, lines[i], results[i]);
+    };
+    std::vector<std::thread> pool{};
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back([&] {
+            auto computer = Computer(image);
+            while (true) {
+                sync.arrive_and_wait();
+                if (done)
+                    return;
+                work(computer);
+                sync.arrive_and_wait();
+            }
+        });
+    }
+
+    auto computer = Computer(image);
+    std::string out{};
+    while (!done) {
+        count = 0;
+        while (count < CHUNK && std::getline(std::cin, lines[count]))
+            count++;
+        next = 0;
+        done = count == 0;
+        sync.arrive_and_wait();
+        if (done)
+            break;
+        work(computer);
+        sync.arrive_and_wait();
+
+        out.clear();
+        for (std::size_t i = 0; i < count; i++) {
+            out += results[i];
+            out += '\n';
+        }
+        std::cout.write(out.data(), out.size());
+    }
+    for (auto &thread : pool)
+        thread.join();
+
+    return 0;
+}
@@ -0,0 +1,762 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <linux/perf_event.h>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// Every heap allocation in the process goes through here so runs can report
+// how many they made.
+std::atomic<uint64_t> allocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+enum class Opcode {
+    add = 1,
+    mul = 2,
+    input = 3,
+    output = 4,
+    jump_true = 5,
+    jump_false = 6,
+    less_than = 7,
+    equals = 8,
+    relative_base = 9,
+    halt = 99,
+};
+
+enum class ParamMode {
+    position = 0,
+    immediate = 1,
+    relative = 2,
+};
+
+typedef long code;
+
+/**
+ * Raised when the program touches an address outside of its memory, i.e. not
+ * in [0, 2^31).
+ */
+class MemoryFault : public std::out_of_range {
+  public:
+    code address;
+    MemoryFault(code address) : std::out_of_range(std::format("memory fault at address {}", address)), address(address) {};
+};
+
+/**
+ * Memory is one anonymous mapping, zero-filled on demand by the kernel, that
+ * covers addresses [0, capacity). A write past it moves the mapping to a
+ * larger one with mremap, which carries the page tables over, so nothing is
+ * copied and untouched pages stay uncommitted. Reads and writes inside the
+ * mapping are plain loads and stores behind one unsigned compare, which also
+ * turns away negative addresses; reads past it are zeroes.
+ *
+ * This class is pasted verbatim into every tool that keeps Intcode memory in
+ * a mapping; keep the copies identical.
+ */
+class Program {
+  private:
+    // Smallest mapping, so that most programs never grow.
+    static constexpr std::size_t MIN_CAPACITY = std::size_t{1} << 16;
+    // Below this many bytes, clearing memory is cheaper than a madvise call.
+    static constexpr std::ptrdiff_t DISCARD_BYTES = 64 << 10;
+
+    code *memory = nullptr;
+    // Words mapped at `memory`, a power of two.
+    std::size_t capacity = 0;
+    // One past the highest address written, so copies know what to clone.
+    std::size_t extent = 0;
+
+    static std::size_t capacity_for(std::size_t words) {
+        return std::max(MIN_CAPACITY, std::bit_ceil(words));
+    }
+    [[gnu::cold]] code read_outside(code index) const {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        return 0;
+    }
+    [[gnu::cold]] void grow(code index) {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        reserve(index + 1);
+    }
+
+  public:
+    // Addresses are [0, WORDS).
+    static constexpr std::size_t WORDS = std::size_t{1} << 31;
+
+    /**
+     * A program of `extent` zero words.
+     */
+    explicit Program(std::size_t extent) : capacity(capacity_for(extent)), extent(extent) {
+        auto region = mmap(nullptr, capacity * sizeof(code), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping intcode memory");
+        memory = static_cast<code *>(region);
+    }
+    Program(const std::vector<code> &image) : Program(image.size()) {
+        std::memcpy(memory, image.data(), image.size() * sizeof(code));
+    }
+    static Program parse(std::istream &input_stream) {
+        std::vector<code> program{};
+        for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
+            auto opcode = std::stol(opcode_s);
+            program.push_back(opcode);
+        }
+        return Program(program);
+    }
+    Program(const Program &other) : Program(other.extent) {
+        std::memcpy(memory, other.memory, extent * sizeof(code));
+    }
+    Program(Program &&other) noexcept : memory(other.memory), capacity(other.capacity), extent(other.extent) {
+        other.memory = nullptr;
+    }
+    Program &operator=(Program other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(capacity, other.capacity);
+        std::swap(extent, other.extent);
+        return *this;
+    }
+    ~Program() {
+        if (memory)
+            munmap(memory, capacity * sizeof(code));
+    }
+
+    code read(code index) const {
+        if (static_cast<uint64_t>(index) < capacity) [[likely]]
+            return memory[index];
+        return read_outside(index);
+    }
+    void write(code index, code value) {
+        if (static_cast<uint64_t>(index) >= capacity) [[unlikely]]
+            grow(index);
+        memory[index] = value;
+        extent = std::max(extent, static_cast<std::size_t>(index) + 1);
+    }
+
+    std::size_t size() const {
+        return extent;
+    }
+    code *data() {
+        return memory;
+    }
+    const code *data() const {
+        return memory;
+    }
+
+    /**
+     * Maps at least `words` words. Growing may move the mapping, which
+     * invalidates pointers from data().
+     */
+    void reserve(std::size_t words) {
+        if (words <= capacity)
+            return;
+        auto bigger = capacity_for(words);
+        auto region = mremap(memory, capacity * sizeof(code), bigger * sizeof(code), MREMAP_MAYMOVE);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "growing intcode memory");
+        memory = static_cast<code *>(region);
+        capacity = bigger;
+    }
+
+    /**
+     * Makes this program's memory equal to `image` again without remapping:
+     * the image is copied back in and whatever was written past its end is
+     * cleared.
+     */
+    void reset(const Program &image) {
+        reserve(image.extent);
+        std::memcpy(memory, image.memory, image.extent * sizeof(code));
+        if (extent > image.extent)
+            clear(image.extent, extent);
+        extent = image.extent;
+    }
+
+    /**
+     * Zeroes words [from, to). Short ranges are overwritten; in longer ones
+     * the whole pages are handed back to the kernel, so the cost follows the
+     * pages actually touched rather than the range: a run that wrote one word
+     * at a high address leaves gigabytes below it that were never faulted in,
+     * and writing zeroes over them would commit them all.
+     */
+    void clear(std::size_t from, std::size_t to) {
+        static const auto page_bytes = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<char *>(memory + from);
+        auto end = reinterpret_cast<char *>(memory + to);
+        auto first = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(begin) + page_bytes - 1) & ~(page_bytes - 1));
+        auto last = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(end) & ~(page_bytes - 1));
+        if (last - first < DISCARD_BYTES) {
+            std::memset(begin, 0, end - begin);
+            return;
+        }
+        std::memset(begin, 0, first - begin);
+        std::memset(last, 0, end - last);
+        if (madvise(first, last - first, MADV_DONTNEED) != 0)
+            throw std::system_error(errno, std::generic_category(), "discarding intcode memory");
+    }
+};
+
+class Instruction {
+  public:
+    Opcode opcode;
+    ParamMode mode1;
+    ParamMode mode2;
+    ParamMode mode3;
+    static Instruction parse(code x) {
+        return Instruction(Opcode(x % 100), ParamMode((x / 100) % 10), ParamMode((x / 1000) % 10), ParamMode((x / 10000) % 10));
+    };
+};
+
+enum class Stop { halted, needs_input, output_full };
+
+class Computer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+    code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return p.read(parameter);
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return p.read(relative_base + parameter);
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return parameter;
+            case ParamMode::relative:
+                return relative_base + parameter;
+            case ParamMode::immediate:
+                throw std::invalid_argument("write operands cannot be in immediate mode");
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+
+  public:
+    // Instructions executed over the computer's lifetime.
+    uint64_t executed = 0;
+
+    Computer(Program p) : p(std::move(p)) {};
+
+    /**
+     * Executes until the program halts, needs an input that `input` cannot
+     * supply, or `output` reaches `output_limit` values. Consumed inputs are
+     * popped and outputs are appended, so the caller can drain both between
+     * calls and keep memory bounded however long the program runs.
+     */
+    Stop run(std::deque<code> &input, std::vector<code> &output, std::size_t output_limit) {
+        assert(!halted);
+
+        while (true) {
+            auto in = Instruction::parse(p.read(pc));
+            executed++;
+
+            switch (in.opcode) {
+                case Opcode::halt: {
+                    halted = true;
+                    return Stop::halted;
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 + arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 * arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty()) {
+                        executed--;
+                        return Stop::needs_input;
+                    }
+                    auto arg1 = eval_write_operand(p.read(pc + 1), in.mode1);
+                    p.write(arg1, input.front());
+                    pc += 2;
+                    input.pop_front();
+                    break;
+                }
+                case Opcode::output: {
+                    if (output.size() >= output_limit) {
+                        executed--;
+                        return Stop::output_full;
+                    }
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    output.push_back(arg1);
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 != 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 == 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 < arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 == arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    relative_base += arg1;
+                    pc += 2;
+                    break;
+                }
+                default: {
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.read(pc)));
+                }
+            }
+        }
+    }
+};
+
+/**
+ * One entry of the decode table. `handler` selects the case in
+ * TableComputer::run, `operands` is how many parameters follow the opcode
+ * word and `length` how far pc moves when the instruction does not jump.
+ * `valid` is false for anything the interpreter must reject: an unknown
+ * opcode, a mode digit above 2, an immediate-mode write, or a non-zero mode
+ * digit for an operand the opcode does not take.
+ */
+struct Decoded {
+    Opcode handler;
+    uint8_t operands;
+    uint8_t length;
+    bool valid;
+    std::array<ParamMode, 3> modes;
+};
+
+// Every word with mode digits of at most 2 is below this; anything at or
+// above it is invalid.
+constexpr std::size_t DECODE_WORDS = 22300;
+
+constexpr std::array<Decoded, DECODE_WORDS> DECODE_TABLE = [] {
+    std::array<Decoded, DECODE_WORDS> table{};
+    for (std::size_t word = 0; word < DECODE_WORDS; word++) {
+        auto opcode = static_cast<Opcode>(word % 100);
+        uint8_t operands = 0;
+        // Which operand, if any, is written.
+        int written = -1;
+        switch (opcode) {
+            case Opcode::add:
+            case Opcode::mul:
+            case Opcode::less_than:
+            case Opcode::equals:
+                operands = 3;
+                written = 2;
+                break;
+            case Opcode::input:
+                operands = 1;
+                written = 0;
+                break;
+            case Opcode::output:
+            case Opcode::relative_base:
+                operands = 1;
+                break;
+            case Opcode::jump_true:
+            case Opcode::jump_false:
+                operands = 2;
+                break;
+            case Opcode::halt:
+                break;
+            default:
+                table[word] = Decoded{opcode, 0, 1, false, {}};
+                continue;
+        }
+        Decoded d{opcode, operands, static_cast<uint8_t>(operands + 1), true, {}};
+        auto digits = word / 100;
+        for (int i = 0; i < 3; i++, digits /= 10) {
+            auto mode = digits % 10;
+            if (mode > 2 || (i >= operands && mode != 0) || (i == written && mode == 1))
+                d.valid = false;
+            d.modes[i] = static_cast<ParamMode>(mode);
+        }
+        table[word] = d;
+    }
+    return table;
+}();
+
+/**
+ * The switch interpreter decoding through DECODE_TABLE: one indexed load per
+ * instruction, with every encoding error caught at that load rather than in
+ * the operand evaluators.
+ */
+class TableComputer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+
+    // Modes are validated by the table, so these need no error cases.
+    code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return p.read(relative_base + parameter);
+            default:
+                return p.read(parameter);
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        return mode == ParamMode::relative ? relative_base + parameter : parameter;
+    }
+
+  public:
+    uint64_t executed = 0;
+
+    TableComputer(Program p) : p(std::move(p)) {};
+
+    static const Decoded &decode(code word) {
+        static constexpr Decoded INVALID{Opcode(0), 0, 1, false, {}};
+        return word >= 0 && static_cast<std::size_t>(word) < DECODE_WORDS ? DECODE_TABLE[word] : INVALID;
+    }
+
+    /**
+     * As Computer::run.
+     */
+    Stop run(std::deque<code> &input, std::vector<code> &output, std::size_t output_limit) {
+        assert(!halted);
+
+        while (true) {
+            auto &d = decode(p.read(pc));
+            if (!d.valid)
+                throw std::invalid_argument(std::format("memory[{}]={} is not a valid instruction", pc, p.read(pc)));
+            executed++;
+
+            switch (d.handler) {
+                case Opcode::halt: {
+                    halted = true;
+                    return Stop::halted;
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), d.modes[0]);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), d.modes[1]);
+                    p.write(eval_write_operand(p.read(pc + 3), d.modes[2]), arg1 + arg2);
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), d.modes[0]);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), d.modes[1]);
+                    p.write(eval_write_operand(p.read(pc + 3), d.modes[2]), arg1 * arg2);
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty()) {
+                        executed--;
+                        return Stop::needs_input;
+                    }
+                    p.write(eval_write_operand(p.read(pc + 1), d.modes[0]), input.front());
+                    input.pop_front();
+                    break;
+                }
+                case Opcode::output: {
+                    if (output.size() >= output_limit) {
+                        executed--;
+                        return Stop::output_full;
+                    }
+                    output.push_back(eval_read_operand(p.read(pc + 1), d.modes[0]));
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), d.modes[0]);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), d.modes[1]);
+                    if (arg1 != 0) {
+                        pc = arg2;
+                        continue;
+                    }
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), d.modes[0]);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), d.modes[1]);
+                    if (arg1 == 0) {
+                        pc = arg2;
+                        continue;
+                    }
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), d.modes[0]);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), d.modes[1]);
+                    p.write(eval_write_operand(p.read(pc + 3), d.modes[2]), arg1 < arg2 ? 1 : 0);
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), d.modes[0]);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), d.modes[1]);
+                    p.write(eval_write_operand(p.read(pc + 3), d.modes[2]), arg1 == arg2 ? 1 : 0);
+                    break;
+                }
+                case Opcode::relative_base: {
+                    relative_base += eval_read_operand(p.read(pc + 1), d.modes[0]);
+                    break;
+                }
+                default: {
+                    std::unreachable();
+                }
+            }
+            pc += d.length;
+        }
+    }
+};
+
+/**
+ * A group of hardware counters read together around a run. Counters the
+ * kernel or hardware refuses (containers, VMs, perf_event_paranoid) are left
+ * out and reported as n/a.
+ */
+class PerfCounters {
+  public:
+    struct Counter {
+        std::string name;
+        uint32_t type;
+        uint64_t config;
+    };
+    static inline const std::vector<Counter> COUNTERS{
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {"L1d-misses",
+             PERF_TYPE_HW_CACHE,
+             PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+            {"LLC-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    };
+
+  private:
+    std::vector<int> fds{};
+
+  public:
+    PerfCounters() {
+        for (auto &counter : COUNTERS) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = counter.type;
+            attr.config = counter.config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds.push_back(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+    }
+    ~PerfCounters() {
+        for (auto fd : fds)
+            if (fd >= 0)
+                close(fd);
+    }
+    void start() {
+        for (auto fd : fds) {
+            if (fd < 0)
+                continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    /**
+     * Stops counting and returns one value per entry of COUNTERS, or -1 for
+     * counters that are unavailable.
+     */
+    std::vector<int64_t> stop() {
+        std::vector<int64_t> values{};
+        for (auto fd : fds) {
+            uint64_t value;
+            if (fd >= 0 && ioctl(fd, PERF_EVENT_IOC_DISABLE, 0) == 0 && read(fd, &value, sizeof(value)) == sizeof(value))
+                values.push_back(value);
+            else
+                values.push_back(-1);
+        }
+        return values;
+    }
+};
+
+/**
+ * What one run produced: the number of VM instructions executed and the
+ * outputs, on which all engines have to agree.
+ */
+struct Run {
+    uint64_t executed;
+    std::vector<code> output;
+};
+
+/**
+ * An engine runs the program to completion on the given inputs.
+ */
+struct Engine {
+    std::string name;
+    std::function<Run(const Program &, const std::vector<code> &)> run;
+};
+
+const std::vector<Engine> ENGINES{
+        {"switch",
+         [](const Program &program, const std::vector<code> &inputs) {
+             auto computer = Computer(program);
+             std::deque<code> input(inputs.begin(), inputs.end());
+             std::vector<code> output{};
+             computer.run(input, output, SIZE_MAX);
+             return Run{computer.executed, std::move(output)};
+         }},
+        {"table",
+         [](const Program &program, const std::vector<code> &inputs) {
+             auto computer = TableComputer(program);
+             std::deque<code> input(inputs.begin(), inputs.end());
+             std::vector<code> output{};
+             computer.run(input, output, SIZE_MAX);
+             return Run{computer.executed, std::move(output)};
+         }},
+};
+
+/**
+ * Usage: bench [--runs N] PROGRAM [INPUT...]
+ *
+ * Runs PROGRAM on every engine N times (default 10) with the given inputs and
+ * reports wall time, hardware counters and heap allocations per executed VM
+ * instruction, plus the process's peak RSS. Exits with 1 if an engine fails, or
+ * executes a different number of instructions or outputs different values than
+ * the first.
+ */
+int main(int argc, char **argv) {
+    int runs = 10;
+    std::string path{};
+    std::vector<code> inputs{};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, std::stoi(argv[++i]));
+        } else if (path.empty() && !arg.starts_with("--")) {
+            path = arg;
+        } else if (!path.empty()) {
+            inputs.push_back(std::stol(arg));
+        } else {
+            std::cerr << std::format("unknown argument {}", arg) << std::endl;
+            return 2;
+        }
+    }
+    if (path.empty()) {
+        std::cerr << "usage: bench [--runs N] PROGRAM [INPUT...]" << std::endl;
+        return 2;
+    }
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << std::format("cannot open {}", path) << std::endl;
+        return 2;
+    }
+    const auto program = Program::parse(file);
+
+    std::cout << std::format("{:<10} {:>12} {:>10}", "engine", "vm-instrs", "ns");
+    for (auto &counter : PerfCounters::COUNTERS)
+        std::cout << std::format(" {:>13}", counter.name);
+    std::cout << std::format(" {:>8}", "allocs") << "    (all per vm instruction)" << std::endl;
+
+    PerfCounters perf{};
+    std::optional<Run> first{};
+    for (auto &engine : ENGINES) {
+        uint64_t executed = 0;
+        std::chrono::nanoseconds elapsed{};
+        std::vector<int64_t> totals(PerfCounters::COUNTERS.size());
+        uint64_t allocs = 0;
+        for (auto r = 0; r < runs; r++) {
+            auto allocs_before = allocations.load();
+            auto start = std::chrono::steady_clock::now();
+            perf.start();
+            Run run{};
+            try {
+                run = engine.run(program, inputs);
+            } catch (std::exception &e) {
+                perf.stop();
+                std::cerr << std::format("{}: {}", engine.name, e.what()) << std::endl;
+                return 1;
+            }
+            auto counts = perf.stop();
+            elapsed += std::chrono::steady_clock::now() - start;
+            allocs += allocations.load() - allocs_before;
+            executed += run.executed;
+            if (!first) {
+                first = std::move(run);
+            } else if (run.executed != first->executed || run.output != first->output) {
+                std::cerr << std::format("{}: instruction count or outputs differ from {}'s", engine.name, ENGINES[0].name) << std::endl;
+                return 1;
+            }
+            for (std::size_t c = 0; c < counts.size(); c++)
+                totals[c] = counts[c] < 0 || totals[c] < 0 ? -1 : totals[c] + counts[c];
+        }
+
+        auto per = [&](double x) { return executed ? x / executed : 0.0; };
+        std::cout << std::format("{:<10} {:>12} {:>10.3f}", engine.name, executed / runs, per(elapsed.count()));
+        for (auto total : totals)
+            std::cout << (total < 0 ? std::format(" {:>13}", "n/a") : std::format(" {:>13.4f}", per(total)));
+        std::cout << std::format(" {:>8.4f}", per(allocs)) << std::endl;
+    }
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << std::format("peak RSS: {} KiB", usage.ru_maxrss) << std::endl;
+
+    return 0;
+}
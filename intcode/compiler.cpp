@@ -0,0 +1,1283 @@
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+enum class Opcode {
+    add = 1,
+    mul = 2,
+    input = 3,
+    output = 4,
+    jump_true = 5,
+    jump_false = 6,
+    less_than = 7,
+    equals = 8,
+    relative_base = 9,
+    halt = 99,
+};
+
+enum class ParamMode {
+    position = 0,
+    immediate = 1,
+    relative = 2,
+};
+
+typedef long code;
+
+/**
+ * Raised for anything wrong with the source, with the line it was found on.
+ */
+class CompileError : public std::invalid_argument {
+  public:
+    CompileError(int line, std::string_view message) : std::invalid_argument(std::format("line {}: {}", line, message)) {};
+};
+
+struct Token {
+    enum class Kind { number, name, symbol, end };
+    Kind kind;
+    std::string text;
+    code value;
+    int line;
+};
+
+std::vector<Token> tokenize(std::string_view source) {
+    std::vector<Token> tokens{};
+    int line = 1;
+    std::size_t i = 0;
+    while (i < source.size()) {
+        auto c = source[i];
+        if (c == '\n') {
+            line++;
+            i++;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (source.substr(i, 2) == "//") {
+            while (i < source.size() && source[i] != '\n')
+                i++;
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            code value = 0;
+            auto [end, error] = std::from_chars(source.data() + i, source.data() + source.size(), value);
+            if (error != std::errc{})
+                throw CompileError(line, "number out of range");
+            auto length = static_cast<std::size_t>(end - (source.data() + i));
+            tokens.push_back({Token::Kind::number, std::string(source.substr(i, length)), value, line});
+            i += length;
+        } else if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            auto start = i;
+            while (i < source.size() && (std::isalnum(static_cast<unsigned char>(source[i])) || source[i] == '_'))
+                i++;
+            tokens.push_back({Token::Kind::name, std::string(source.substr(start, i - start)), 0, line});
+        } else {
+            auto pair = source.substr(i, 2);
+            if (pair == "==" || pair == "!=" || pair == "<=" || pair == ">=") {
+                tokens.push_back({Token::Kind::symbol, std::string(pair), 0, line});
+                i += 2;
+            } else if (std::string_view("+-*<>=!(){},;").find(c) != std::string_view::npos) {
+                tokens.push_back({Token::Kind::symbol, std::string(1, c), 0, line});
+                i++;
+            } else {
+                throw CompileError(line, std::format("unexpected character '{}'", c));
+            }
+        }
+    }
+    tokens.push_back({Token::Kind::end, "end of input", 0, line});
+    return tokens;
+}
+
+/**
+ * `name` is the variable or callee for those kinds and the operator for unary
+ * and binary ones; `args` holds the operands or call arguments.
+ */
+struct Expr {
+    enum class Kind { number, variable, input, call, unary, binary };
+    Kind kind;
+    int line;
+    code value = 0;
+    std::string name{};
+    std::vector<Expr> args{};
+};
+
+/**
+ * `name` is the variable of a declaration or assignment. A branch runs `body`
+ * or `orelse`; a loop runs `body`.
+ */
+struct Stmt {
+    enum class Kind { declare, assign, branch, loop, ret, output, expression };
+    Kind kind;
+    int line;
+    std::string name{};
+    std::optional<Expr> expr{};
+    std::vector<Stmt> body{};
+    std::vector<Stmt> orelse{};
+};
+
+struct Function {
+    std::string name;
+    std::vector<std::string> params;
+    std::vector<Stmt> body;
+    int line;
+};
+
+/**
+ * Recursive descent over the grammar
+ *
+ *     program  := function*
+ *     function := "fn" name "(" [name {"," name}] ")" block
+ *     block    := "{" stmt* "}"
+ *     stmt     := "var" name "=" expr ";" | name "=" expr ";" | "return" [expr] ";"
+ *               | "output" "(" expr ")" ";" | expr ";"
+ *               | "if" "(" expr ")" block ["else" (block | if-stmt)]
+ *               | "while" "(" expr ")" block
+ *     expr     := sum {("==" | "!=" | "<" | ">" | "<=" | ">=") sum}
+ *     sum      := product {("+" | "-") product}
+ *     product  := unary {"*" unary}
+ *     unary    := ("-" | "!") unary | number | name | name "(" [expr {"," expr}] ")"
+ *               | "input" "(" ")" | "(" expr ")"
+ */
+class Parser {
+  private:
+    std::vector<Token> tokens;
+    std::size_t at = 0;
+
+    const Token &peek() const {
+        return tokens[at];
+    }
+    bool is(std::string_view text) const {
+        return peek().kind != Token::Kind::number && peek().text == text;
+    }
+    bool accept(std::string_view text) {
+        if (!is(text))
+            return false;
+        at++;
+        return true;
+    }
+    const Token &expect(std::string_view text) {
+        if (!is(text))
+            throw CompileError(peek().line, std::format("expected '{}' but found '{}'", text, peek().text));
+        return tokens[at++];
+    }
+    std::string expect_name() {
+        if (peek().kind != Token::Kind::name)
+            throw CompileError(peek().line, std::format("expected a name but found '{}'", peek().text));
+        return tokens[at++].text;
+    }
+
+    std::vector<Stmt> block() {
+        expect("{");
+        std::vector<Stmt> body{};
+        while (!accept("}"))
+            body.push_back(statement());
+        return body;
+    }
+
+    Stmt statement() {
+        auto line = peek().line;
+        if (accept("var")) {
+            Stmt s{Stmt::Kind::declare, line, expect_name()};
+            expect("=");
+            s.expr = expression();
+            expect(";");
+            return s;
+        }
+        if (accept("if")) {
+            Stmt s{Stmt::Kind::branch, line};
+            expect("(");
+            s.expr = expression();
+            expect(")");
+            s.body = block();
+            if (accept("else")) {
+                if (is("if"))
+                    s.orelse.push_back(statement());
+                else
+                    s.orelse = block();
+            }
+            return s;
+        }
+        if (accept("while")) {
+            Stmt s{Stmt::Kind::loop, line};
+            expect("(");
+            s.expr = expression();
+            expect(")");
+            s.body = block();
+            return s;
+        }
+        if (accept("return")) {
+            Stmt s{Stmt::Kind::ret, line};
+            if (!is(";"))
+                s.expr = expression();
+            expect(";");
+            return s;
+        }
+        if (accept("output")) {
+            Stmt s{Stmt::Kind::output, line};
+            expect("(");
+            s.expr = expression();
+            expect(")");
+            expect(";");
+            return s;
+        }
+        if (peek().kind == Token::Kind::name && tokens[at + 1].text == "=") {
+            Stmt s{Stmt::Kind::assign, line, expect_name()};
+            expect("=");
+            s.expr = expression();
+            expect(";");
+            return s;
+        }
+        Stmt s{Stmt::Kind::expression, line};
+        s.expr = expression();
+        expect(";");
+        return s;
+    }
+
+    Expr binary(std::string op, Expr lhs, Expr rhs) {
+        Expr e{Expr::Kind::binary, lhs.line, 0, std::move(op)};
+        e.args.push_back(std::move(lhs));
+        e.args.push_back(std::move(rhs));
+        return e;
+    }
+
+    Expr expression() {
+        auto e = sum();
+        for (auto op : {"==", "!=", "<", ">", "<=", ">="}) {
+            if (accept(op))
+                return binary(op, std::move(e), sum());
+        }
+        return e;
+    }
+
+    Expr sum() {
+        auto e = product();
+        while (true) {
+            if (accept("+"))
+                e = binary("+", std::move(e), product());
+            else if (accept("-"))
+                e = binary("-", std::move(e), product());
+            else
+                return e;
+        }
+    }
+
+    Expr product() {
+        auto e = unary();
+        while (accept("*"))
+            e = binary("*", std::move(e), unary());
+        return e;
+    }
+
+    Expr unary() {
+        auto &token = peek();
+        auto line = token.line;
+        for (auto op : {"-", "!"}) {
+            if (accept(op)) {
+                Expr e{Expr::Kind::unary, line, 0, op};
+                e.args.push_back(unary());
+                return e;
+            }
+        }
+        if (token.kind == Token::Kind::number) {
+            at++;
+            return Expr{Expr::Kind::number, line, token.value};
+        }
+        if (accept("(")) {
+            auto e = expression();
+            expect(")");
+            return e;
+        }
+        if (accept("input")) {
+            expect("(");
+            expect(")");
+            return Expr{Expr::Kind::input, line};
+        }
+        auto name = expect_name();
+        if (!accept("("))
+            return Expr{Expr::Kind::variable, line, 0, name};
+        Expr e{Expr::Kind::call, line, 0, name};
+        if (!accept(")")) {
+            do {
+                e.args.push_back(expression());
+            } while (accept(","));
+            expect(")");
+        }
+        return e;
+    }
+
+  public:
+    Parser(std::vector<Token> tokens) : tokens(std::move(tokens)) {};
+
+    std::vector<Function> parse() {
+        std::vector<Function> functions{};
+        while (peek().kind != Token::Kind::end) {
+            auto line = peek().line;
+            expect("fn");
+            Function f{expect_name(), {}, {}, line};
+            expect("(");
+            if (!accept(")")) {
+                do {
+                    f.params.push_back(expect_name());
+                } while (accept(","));
+                expect(")");
+            }
+            f.body = block();
+            functions.push_back(std::move(f));
+        }
+        return functions;
+    }
+};
+
+bool has_effects(const Expr &e) {
+    if (e.kind == Expr::Kind::call || e.kind == Expr::Kind::input)
+        return true;
+    return std::any_of(e.args.begin(), e.args.end(), has_effects);
+}
+
+bool has_call(const Expr &e) {
+    if (e.kind == Expr::Kind::call)
+        return true;
+    return std::any_of(e.args.begin(), e.args.end(), has_call);
+}
+
+/**
+ * Source-level optimizations: constant folding and propagation, algebraic
+ * identities, and removal of dead code (untaken branches, statements after a return, stores
+ * to variables that are never read, and functions main never reaches).
+ */
+class Optimizer {
+  private:
+    std::unordered_set<std::string> read{};
+    // Variables stored exactly once, by a declaration with a constant.
+    std::unordered_map<std::string, code> constants{};
+    bool changed = false;
+
+    static std::optional<code> constant(const Expr &e) {
+        if (e.kind == Expr::Kind::number)
+            return e.value;
+        return std::nullopt;
+    }
+    static inline const std::unordered_map<std::string, std::string> INVERSE{
+            {"==", "!="}, {"!=", "=="}, {"<", ">="}, {">=", "<"}, {">", "<="}, {"<=", ">"},
+    };
+
+    static Expr number(int line, code value) {
+        return Expr{Expr::Kind::number, line, value};
+    }
+
+    void fold(Expr &e) {
+        for (auto &arg : e.args)
+            fold(arg);
+        if (e.kind == Expr::Kind::variable) {
+            if (auto it = constants.find(e.name); it != constants.end()) {
+                e = number(e.line, it->second);
+                changed = true;
+            }
+            return;
+        }
+        if (e.kind == Expr::Kind::unary) {
+            if (auto a = constant(e.args[0])) {
+                e = number(e.line, e.name == "-" ? -*a : !*a);
+                changed = true;
+            } else if (e.name == "!" && INVERSE.contains(e.args[0].name) && e.args[0].kind == Expr::Kind::binary) {
+                // !(a < b) is a >= b, and so on.
+                Expr inner = std::move(e.args[0]);
+                e = std::move(inner);
+                e.name = INVERSE.at(e.name);
+                changed = true;
+            }
+            return;
+        }
+        if (e.kind != Expr::Kind::binary)
+            return;
+        auto a = constant(e.args[0]);
+        auto b = constant(e.args[1]);
+        if (a && b) {
+            code value = 0;
+            if (e.name == "+")
+                value = *a + *b;
+            else if (e.name == "-")
+                value = *a - *b;
+            else if (e.name == "*")
+                value = *a * *b;
+            else if (e.name == "==")
+                value = *a == *b;
+            else if (e.name == "!=")
+                value = *a != *b;
+            else if (e.name == "<")
+                value = *a < *b;
+            else if (e.name == ">")
+                value = *a > *b;
+            else if (e.name == "<=")
+                value = *a <= *b;
+            else
+                value = *a >= *b;
+            e = number(e.line, value);
+            changed = true;
+            return;
+        }
+        // x + 0, 0 + x, x - 0, x * 1, 1 * x: the other operand is the result.
+        auto keep = [&](std::size_t i) {
+            Expr kept = std::move(e.args[i]);
+            e = std::move(kept);
+            changed = true;
+        };
+        if (e.name == "+" && a == 0)
+            return keep(1);
+        if ((e.name == "+" || e.name == "-") && b == 0)
+            return keep(0);
+        if (e.name == "*" && a == 1)
+            return keep(1);
+        if (e.name == "*" && b == 1)
+            return keep(0);
+        // x * 0 is 0 as long as evaluating x does nothing else.
+        if (e.name == "*" && (a == 0 || b == 0) && !has_effects(e.args[a == 0 ? 1 : 0])) {
+            e = number(e.line, 0);
+            changed = true;
+        }
+    }
+
+    void collect_reads(const Expr &e) {
+        if (e.kind == Expr::Kind::variable)
+            read.insert(e.name);
+        for (auto &arg : e.args)
+            collect_reads(arg);
+    }
+    void collect_reads(const std::vector<Stmt> &body) {
+        for (auto &s : body) {
+            if (s.expr)
+                collect_reads(*s.expr);
+            collect_reads(s.body);
+            collect_reads(s.orelse);
+        }
+    }
+
+    static void count_stores(const std::vector<Stmt> &body, std::unordered_map<std::string, std::pair<int, const Expr *>> &stores) {
+        for (auto &s : body) {
+            if (s.kind == Stmt::Kind::declare || s.kind == Stmt::Kind::assign) {
+                auto &[count, value] = stores[s.name];
+                count++;
+                value = s.kind == Stmt::Kind::declare ? &*s.expr : nullptr;
+            }
+            count_stores(s.body, stores);
+            count_stores(s.orelse, stores);
+        }
+    }
+
+    /**
+     * Folds and prunes `body` in place. Returns whether control can fall off
+     * its end, i.e. it does not end in a return on every path.
+     */
+    bool prune(std::vector<Stmt> &body) {
+        std::vector<Stmt> kept{};
+        bool falls_through = true;
+        for (auto &s : body) {
+            if (!falls_through) {
+                changed = true;
+                continue;
+            }
+            if (s.expr)
+                fold(*s.expr);
+            switch (s.kind) {
+                case Stmt::Kind::declare:
+                case Stmt::Kind::assign: {
+                    if (read.contains(s.name))
+                        break;
+                    changed = true;
+                    if (!has_effects(*s.expr))
+                        continue;
+                    // Dead store, but the value still has to be computed.
+                    s.kind = Stmt::Kind::expression;
+                    break;
+                }
+                case Stmt::Kind::expression: {
+                    if (!has_effects(*s.expr)) {
+                        changed = true;
+                        continue;
+                    }
+                    break;
+                }
+                case Stmt::Kind::branch: {
+                    if (auto c = constant(*s.expr)) {
+                        auto &taken = *c ? s.body : s.orelse;
+                        auto declares = std::any_of(taken.begin(), taken.end(), [](const Stmt &t) { return t.kind == Stmt::Kind::declare; });
+                        if (!declares) {
+                            falls_through = prune(taken);
+                            std::move(taken.begin(), taken.end(), std::back_inserter(kept));
+                            changed = true;
+                            continue;
+                        }
+                        // Declarations keep their block, as an `if (1)` the
+                        // generator emits without a test.
+                        if (*c != 1 || !s.orelse.empty()) {
+                            auto body = std::move(taken);
+                            s.body = std::move(body);
+                            s.orelse.clear();
+                            s.expr = number(s.line, 1);
+                            changed = true;
+                        }
+                        falls_through = prune(s.body);
+                        break;
+                    }
+                    auto body_falls = prune(s.body);
+                    auto orelse_falls = prune(s.orelse);
+                    falls_through = body_falls || orelse_falls;
+                    break;
+                }
+                case Stmt::Kind::loop: {
+                    auto c = constant(*s.expr);
+                    if (c == 0) {
+                        changed = true;
+                        continue;
+                    }
+                    prune(s.body);
+                    // There is no break, so only a return leaves `while (1)`.
+                    falls_through = !c;
+                    break;
+                }
+                case Stmt::Kind::ret: {
+                    falls_through = false;
+                    break;
+                }
+                default:
+                    break;
+            }
+            kept.push_back(std::move(s));
+        }
+        body = std::move(kept);
+        return falls_through;
+    }
+
+    static void collect_calls(const Expr &e, std::vector<std::string> &calls) {
+        if (e.kind == Expr::Kind::call)
+            calls.push_back(e.name);
+        for (auto &arg : e.args)
+            collect_calls(arg, calls);
+    }
+    static void collect_calls(const std::vector<Stmt> &body, std::vector<std::string> &calls) {
+        for (auto &s : body) {
+            if (s.expr)
+                collect_calls(*s.expr, calls);
+            collect_calls(s.body, calls);
+            collect_calls(s.orelse, calls);
+        }
+    }
+
+  public:
+    void run(std::vector<Function> &functions) {
+        for (auto &f : functions) {
+            // Each round can expose more: a folded branch drops the only read
+            // of a variable, whose dead store then drops a read of another.
+            do {
+                changed = false;
+                read.clear();
+                collect_reads(f.body);
+                std::unordered_map<std::string, std::pair<int, const Expr *>> stores{};
+                for (auto &param : f.params)
+                    stores[param].first++;
+                count_stores(f.body, stores);
+                constants.clear();
+                for (auto &[name, store] : stores) {
+                    if (store.first == 1 && store.second && store.second->kind == Expr::Kind::number)
+                        constants[name] = store.second->value;
+                }
+                prune(f.body);
+            } while (changed);
+        }
+
+        std::unordered_map<std::string, const Function *> by_name{};
+        for (auto &f : functions)
+            by_name[f.name] = &f;
+        std::unordered_set<std::string> reached{"main"};
+        std::vector<std::string> pending{"main"};
+        while (!pending.empty()) {
+            auto name = pending.back();
+            pending.pop_back();
+            auto it = by_name.find(name);
+            if (it == by_name.end())
+                continue;
+            std::vector<std::string> calls{};
+            collect_calls(it->second->body, calls);
+            for (auto &callee : calls) {
+                if (reached.insert(callee).second)
+                    pending.push_back(callee);
+            }
+        }
+        std::erase_if(functions, [&](const Function &f) { return !reached.contains(f.name); });
+    }
+};
+
+/**
+ * An operand before layout. `slot` is relative to the current frame. The
+ * current function's frame size is only known once all of it is generated, so
+ * `outgoing` slots (the callee's frame, starting just past ours) and `frame`
+ * immediates (the frame size times `value`) are patched then. `label` is an
+ * immediate code address, patched once the whole program is laid out. `temp`
+ * marks a slot that belongs to the expression that produced it.
+ */
+struct Operand {
+    enum class Kind { immediate, slot, outgoing, frame, label };
+    Kind kind;
+    code value;
+    bool temp = false;
+
+    bool operator==(const Operand &other) const {
+        return kind == other.kind && value == other.value;
+    }
+};
+
+/**
+ * Generates Intcode under the relative-base calling convention the runner's
+ * --memoize understands. The caller stores the return address in the first
+ * word past its frame and the arguments after it, then runs `rb += frame;
+ * jump f`. The callee's frame starts at the new relative base: slot 0 holds
+ * the return address, slots 1.. the parameters, and on return slot 1 the
+ * result. The caller moves rb back after the jump returns.
+ *
+ * The naive mode is a straightforward translation for comparison: every
+ * constant and every intermediate result gets a slot of its own and is then
+ * copied where it is needed.
+ */
+class Generator {
+  private:
+    struct Fixup {
+        std::size_t word;
+        Operand operand;
+    };
+
+    bool optimize;
+    std::vector<code> words{};
+    std::vector<code> labels{};
+    std::vector<Fixup> label_fixups{};
+    std::unordered_map<std::string, std::pair<std::size_t, std::size_t>> functions{};
+
+    // The function being generated.
+    std::vector<Fixup> frame_fixups{};
+    std::vector<bool> used{};
+    std::vector<std::vector<std::pair<std::string, code>>> scopes{};
+    std::size_t return_label = 0;
+
+    std::size_t new_label() {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+    void place(std::size_t label) {
+        labels[label] = static_cast<code>(words.size());
+    }
+
+    void emit(Opcode opcode, std::initializer_list<Operand> operands) {
+        code instruction = static_cast<code>(opcode);
+        code scale = 100;
+        for (auto &operand : operands) {
+            auto relative = operand.kind == Operand::Kind::slot || operand.kind == Operand::Kind::outgoing;
+            instruction += scale * static_cast<code>(relative ? ParamMode::relative : ParamMode::immediate);
+            scale *= 10;
+        }
+        words.push_back(instruction);
+        for (auto &operand : operands) {
+            if (operand.kind == Operand::Kind::label)
+                label_fixups.push_back({words.size(), operand});
+            else if (operand.kind == Operand::Kind::outgoing || operand.kind == Operand::Kind::frame)
+                frame_fixups.push_back({words.size(), operand});
+            words.push_back(operand.value);
+        }
+    }
+
+    static Operand immediate(code value) {
+        return Operand{Operand::Kind::immediate, value};
+    }
+    static Operand label(std::size_t label) {
+        return Operand{Operand::Kind::label, static_cast<code>(label)};
+    }
+    static Operand outgoing(code offset) {
+        return Operand{Operand::Kind::outgoing, offset};
+    }
+
+    /**
+     * The lowest free slot, or in naive mode always a new one.
+     */
+    Operand allocate(bool temp) {
+        std::size_t slot = optimize ? std::find(used.begin(), used.end(), false) - used.begin() : used.size();
+        if (slot == used.size())
+            used.push_back(true);
+        used[slot] = true;
+        return Operand{Operand::Kind::slot, static_cast<code>(slot), temp};
+    }
+    void release(const Operand &operand) {
+        if (operand.temp && optimize)
+            used[operand.value] = false;
+    }
+
+    code lookup(const Expr &e) {
+        for (auto scope = scopes.rbegin(); scope != scopes.rend(); scope++) {
+            for (auto &[name, slot] : *scope) {
+                if (name == e.name)
+                    return slot;
+            }
+        }
+        throw CompileError(e.line, std::format("unknown variable '{}'", e.name));
+    }
+
+    void move(const Operand &from, const Operand &to) {
+        if (!(from == to))
+            emit(Opcode::add, {from, immediate(0), to});
+    }
+
+    /**
+     * Where `e`'s value can be read from. A call's result is left in the
+     * outgoing frame, so it has to be used before the next call is made.
+     */
+    Operand value(const Expr &e) {
+        switch (e.kind) {
+            case Expr::Kind::number: {
+                if (optimize)
+                    return immediate(e.value);
+                auto temp = allocate(true);
+                move(immediate(e.value), temp);
+                return temp;
+            }
+            case Expr::Kind::variable:
+                return Operand{Operand::Kind::slot, lookup(e)};
+            case Expr::Kind::call: {
+                call(e);
+                if (optimize)
+                    return outgoing(1);
+                auto temp = allocate(true);
+                move(outgoing(1), temp);
+                return temp;
+            }
+            default: {
+                auto temp = allocate(true);
+                compute(e, temp);
+                return temp;
+            }
+        }
+    }
+
+    /**
+     * Evaluates `e` into `dest`.
+     */
+    void into(const Expr &e, const Operand &dest) {
+        if (!optimize || e.kind == Expr::Kind::number || e.kind == Expr::Kind::variable) {
+            auto from = value(e);
+            move(from, dest);
+            release(from);
+        } else if (e.kind == Expr::Kind::call) {
+            call(e);
+            move(outgoing(1), dest);
+        } else {
+            compute(e, dest);
+        }
+    }
+
+    /**
+     * Evaluates an input, unary or binary expression into `dest`, which the
+     * operands may alias.
+     */
+    void compute(const Expr &e, const Operand &dest) {
+        if (e.kind == Expr::Kind::input) {
+            emit(Opcode::input, {dest});
+            return;
+        }
+        if (e.kind == Expr::Kind::unary) {
+            auto a = value(e.args[0]);
+            if (e.name == "-")
+                emit(Opcode::mul, {a, immediate(-1), dest});
+            else
+                emit(Opcode::equals, {a, immediate(0), dest});
+            release(a);
+            return;
+        }
+
+        auto a = value(e.args[0]);
+        if (a.kind == Operand::Kind::outgoing && has_call(e.args[1])) {
+            auto saved = allocate(true);
+            move(a, saved);
+            a = saved;
+        }
+        auto b = value(e.args[1]);
+        auto &op = e.name;
+        if (op == "+") {
+            emit(Opcode::add, {a, b, dest});
+        } else if (op == "*") {
+            emit(Opcode::mul, {a, b, dest});
+        } else if (op == "-") {
+            if (optimize && b.kind == Operand::Kind::immediate) {
+                emit(Opcode::add, {a, immediate(-b.value), dest});
+            } else {
+                // dest can hold -b unless that would overwrite a first.
+                auto negated = optimize && !(dest == a) ? dest : allocate(true);
+                emit(Opcode::mul, {b, immediate(-1), negated});
+                emit(Opcode::add, {a, negated, dest});
+                if (!(negated == dest))
+                    release(negated);
+            }
+        } else if (op == "<") {
+            emit(Opcode::less_than, {a, b, dest});
+        } else if (op == ">") {
+            emit(Opcode::less_than, {b, a, dest});
+        } else if (op == "==") {
+            emit(Opcode::equals, {a, b, dest});
+        } else if (optimize && op == "<=" && b.kind == Operand::Kind::immediate && b.value < INT64_MAX) {
+            emit(Opcode::less_than, {a, immediate(b.value + 1), dest});
+        } else if (optimize && op == ">=" && b.kind == Operand::Kind::immediate && b.value > INT64_MIN) {
+            emit(Opcode::less_than, {immediate(b.value - 1), a, dest});
+        } else {
+            // <=, >= and != are the negations of >, < and ==.
+            if (op == "<=")
+                emit(Opcode::less_than, {b, a, dest});
+            else if (op == ">=")
+                emit(Opcode::less_than, {a, b, dest});
+            else
+                emit(Opcode::equals, {a, b, dest});
+            emit(Opcode::equals, {dest, immediate(0), dest});
+        }
+        release(a);
+        release(b);
+    }
+
+    /**
+     * Calls `e`, leaving the result in slot 1 of the outgoing frame.
+     */
+    void call(const Expr &e) {
+        auto it = functions.find(e.name);
+        if (it == functions.end())
+            throw CompileError(e.line, std::format("unknown function '{}'", e.name));
+        auto [entry, arity] = it->second;
+        if (e.args.size() != arity)
+            throw CompileError(e.line, std::format("'{}' takes {} arguments, not {}", e.name, arity, e.args.size()));
+
+        // A call inside an argument reuses the outgoing frame, so arguments
+        // with calls (or input, to keep the order) go to temporaries first,
+        // except the last of them, which nothing runs after.
+        std::vector<std::optional<Operand>> saved(e.args.size());
+        std::optional<std::size_t> last_call{};
+        for (std::size_t i = 0; i < e.args.size(); i++) {
+            if (!optimize || has_effects(e.args[i]))
+                last_call = i;
+        }
+        for (std::size_t i = 0; i < e.args.size(); i++) {
+            if ((!optimize || has_effects(e.args[i])) && i != last_call) {
+                saved[i] = optimize ? allocate(true) : value(e.args[i]);
+                if (optimize)
+                    into(e.args[i], *saved[i]);
+            }
+        }
+        if (last_call)
+            into(e.args[*last_call], outgoing(static_cast<code>(*last_call) + 1));
+        for (std::size_t i = 0; i < e.args.size(); i++) {
+            if (saved[i]) {
+                move(*saved[i], outgoing(static_cast<code>(i) + 1));
+                release(*saved[i]);
+            } else if (i != last_call) {
+                into(e.args[i], outgoing(static_cast<code>(i) + 1));
+            }
+        }
+
+        auto back = new_label();
+        move(label(back), outgoing(0));
+        emit(Opcode::relative_base, {Operand{Operand::Kind::frame, 1}});
+        emit(Opcode::jump_true, {immediate(1), label(entry)});
+        place(back);
+        emit(Opcode::relative_base, {Operand{Operand::Kind::frame, -1}});
+    }
+
+    /**
+     * Jumps to `target` if `e` is true (`when`) or false (!`when`).
+     */
+    void branch(const Expr &e, bool when, std::size_t target) {
+        if (optimize && e.kind == Expr::Kind::unary && e.name == "!")
+            return branch(e.args[0], !when, target);
+        if (optimize && e.kind == Expr::Kind::binary && (e.name == "==" || e.name == "!=")) {
+            // x == 0 and x != 0 test x itself.
+            for (std::size_t i = 0; i < 2; i++) {
+                if (e.args[i].kind == Expr::Kind::number && e.args[i].value == 0)
+                    return branch(e.args[1 - i], e.name == "!=" ? when : !when, target);
+            }
+        }
+        if (optimize && e.kind == Expr::Kind::binary && e.name != "+" && e.name != "-" && e.name != "*") {
+            // Test the comparison's own result rather than a normalized one:
+            // a != b jumps on a == b being false, and so on.
+            auto a = value(e.args[0]);
+            if (a.kind == Operand::Kind::outgoing && has_call(e.args[1])) {
+                auto saved = allocate(true);
+                move(a, saved);
+                a = saved;
+            }
+            auto b = value(e.args[1]);
+            auto temp = allocate(true);
+            auto &op = e.name;
+            auto negated = op == "!=" || op == "<=" || op == ">=";
+            if (op == "==" || op == "!=")
+                emit(Opcode::equals, {a, b, temp});
+            else if (op == "<" || op == ">=")
+                emit(Opcode::less_than, {a, b, temp});
+            else
+                emit(Opcode::less_than, {b, a, temp});
+            emit(when != negated ? Opcode::jump_true : Opcode::jump_false, {temp, label(target)});
+            release(temp);
+            release(a);
+            release(b);
+            return;
+        }
+        auto v = value(e);
+        emit(when ? Opcode::jump_true : Opcode::jump_false, {v, label(target)});
+        release(v);
+    }
+
+    void block(const std::vector<Stmt> &body) {
+        scopes.emplace_back();
+        for (auto &s : body)
+            statement(s);
+        for (auto &[name, slot] : scopes.back())
+            release(Operand{Operand::Kind::slot, slot, true});
+        scopes.pop_back();
+    }
+
+    void statement(const Stmt &s) {
+        switch (s.kind) {
+            case Stmt::Kind::declare: {
+                for (auto &scope : scopes) {
+                    for (auto &[name, slot] : scope) {
+                        if (name == s.name)
+                            throw CompileError(s.line, std::format("'{}' is already declared", s.name));
+                    }
+                }
+                auto slot = allocate(false);
+                into(*s.expr, slot);
+                scopes.back().emplace_back(s.name, slot.value);
+                break;
+            }
+            case Stmt::Kind::assign: {
+                auto slot = lookup(Expr{Expr::Kind::variable, s.line, 0, s.name});
+                into(*s.expr, Operand{Operand::Kind::slot, slot});
+                break;
+            }
+            case Stmt::Kind::branch: {
+                if (optimize && s.expr->kind == Expr::Kind::number) {
+                    block(s.expr->value ? s.body : s.orelse);
+                    break;
+                }
+                auto orelse = new_label();
+                auto end = new_label();
+                branch(*s.expr, false, orelse);
+                block(s.body);
+                if (!s.orelse.empty())
+                    emit(Opcode::jump_true, {immediate(1), label(end)});
+                place(orelse);
+                block(s.orelse);
+                place(end);
+                break;
+            }
+            case Stmt::Kind::loop: {
+                auto top = new_label();
+                auto test = new_label();
+                auto end = new_label();
+                if (optimize) {
+                    // Test at the bottom: one jump per iteration, not two.
+                    emit(Opcode::jump_true, {immediate(1), label(test)});
+                    place(top);
+                    block(s.body);
+                    place(test);
+                    branch(*s.expr, true, top);
+                } else {
+                    place(top);
+                    branch(*s.expr, false, end);
+                    block(s.body);
+                    emit(Opcode::jump_true, {immediate(1), label(top)});
+                }
+                place(end);
+                break;
+            }
+            case Stmt::Kind::ret: {
+                if (s.expr)
+                    into(*s.expr, Operand{Operand::Kind::slot, 1});
+                else
+                    move(immediate(0), Operand{Operand::Kind::slot, 1});
+                if (optimize)
+                    emit(Opcode::jump_true, {immediate(1), Operand{Operand::Kind::slot, 0}});
+                else
+                    emit(Opcode::jump_true, {immediate(1), label(return_label)});
+                break;
+            }
+            case Stmt::Kind::output: {
+                auto v = value(*s.expr);
+                emit(Opcode::output, {v});
+                release(v);
+                break;
+            }
+            case Stmt::Kind::expression: {
+                if (optimize && s.expr->kind == Expr::Kind::call) {
+                    call(*s.expr);
+                } else {
+                    auto v = value(*s.expr);
+                    release(v);
+                }
+                break;
+            }
+        }
+    }
+
+    void function(const Function &f) {
+        frame_fixups.clear();
+        scopes.assign(1, {});
+        // Slot 0 is the return address and slot 1 the result, which may be
+        // the first parameter's slot.
+        used.assign(std::max<std::size_t>(2, f.params.size() + 1), true);
+        for (std::size_t i = 0; i < f.params.size(); i++) {
+            for (std::size_t j = 0; j < i; j++) {
+                if (f.params[j] == f.params[i])
+                    throw CompileError(f.line, std::format("parameter '{}' is repeated", f.params[i]));
+            }
+            scopes.back().emplace_back(f.params[i], static_cast<code>(i) + 1);
+        }
+        return_label = new_label();
+
+        place(functions.at(f.name).first);
+        block(f.body);
+        // Optimized returns jump back themselves, so a function ending in one
+        // needs no epilogue.
+        if (!optimize || f.body.empty() || f.body.back().kind != Stmt::Kind::ret) {
+            move(immediate(0), Operand{Operand::Kind::slot, 1});
+            place(return_label);
+            emit(Opcode::jump_true, {immediate(1), Operand{Operand::Kind::slot, 0}});
+        }
+
+        auto frame = static_cast<code>(used.size());
+        for (auto &fixup : frame_fixups)
+            words[fixup.word] = fixup.operand.kind == Operand::Kind::outgoing ? frame + fixup.operand.value : frame * fixup.operand.value;
+    }
+
+  public:
+    Generator(bool optimize) : optimize(optimize) {};
+
+    std::vector<code> generate(const std::vector<Function> &program) {
+        for (auto &f : program) {
+            if (!functions.emplace(f.name, std::pair{new_label(), f.params.size()}).second)
+                throw CompileError(f.line, std::format("function '{}' is already defined", f.name));
+        }
+        auto main = functions.find("main");
+        if (main == functions.end())
+            throw CompileError(1, "no main function");
+        if (main->second.second != 0)
+            throw CompileError(1, "main takes no parameters");
+
+        // Start the stack past the code and call main, whose return halts.
+        auto stack = new_label();
+        auto halt = new_label();
+        emit(Opcode::relative_base, {label(stack)});
+        move(label(halt), Operand{Operand::Kind::slot, 0});
+        emit(Opcode::jump_true, {immediate(1), label(main->second.first)});
+        place(halt);
+        emit(Opcode::halt, {});
+        for (auto &f : program)
+            function(f);
+        place(stack);
+
+        for (auto &fixup : label_fixups)
+            words[fixup.word] = labels[fixup.operand.value];
+        return words;
+    }
+};
+
+std::vector<code> compile(std::string_view source, bool optimize) {
+    auto program = Parser(tokenize(source)).parse();
+    if (optimize)
+        Optimizer().run(program);
+    return Generator(optimize).generate(program);
+}
+
+/**
+ * The day09 interpreter, untraced and counting instructions, to compare what
+ * the two modes generate.
+ */
+class Computer {
+  private:
+    std::vector<code> memory;
+    code pc = 0;
+    code relative_base = 0;
+
+    code read(code index) {
+        if (index < 0)
+            throw std::out_of_range(std::format("memory fault at address {}", index));
+        return static_cast<std::size_t>(index) < memory.size() ? memory[index] : 0;
+    }
+    void write(code index, code value) {
+        if (index < 0)
+            throw std::out_of_range(std::format("memory fault at address {}", index));
+        if (static_cast<std::size_t>(index) >= memory.size())
+            memory.resize(index + 1);
+        memory[index] = value;
+    }
+    code eval_read_operand(code parameter, code mode) {
+        return mode == 1 ? parameter : read(mode == 2 ? relative_base + parameter : parameter);
+    }
+    code eval_write_operand(code parameter, code mode) {
+        return mode == 2 ? relative_base + parameter : parameter;
+    }
+
+  public:
+    uint64_t executed = 0;
+
+    Computer(std::vector<code> memory) : memory(std::move(memory)) {};
+
+    std::vector<code> run(std::deque<code> input) {
+        std::vector<code> output{};
+        while (true) {
+            auto word = read(pc);
+            auto opcode = static_cast<Opcode>(word % 100);
+            auto mode1 = (word / 100) % 10, mode2 = (word / 1000) % 10, mode3 = (word / 10000) % 10;
+            executed++;
+            switch (opcode) {
+                case Opcode::halt:
+                    return output;
+                case Opcode::add:
+                case Opcode::mul:
+                case Opcode::less_than:
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(read(pc + 1), mode1);
+                    auto arg2 = eval_read_operand(read(pc + 2), mode2);
+                    auto arg3 = eval_write_operand(read(pc + 3), mode3);
+                    code result = opcode == Opcode::add ? arg1 + arg2 : opcode == Opcode::mul ? arg1 * arg2 : opcode == Opcode::less_than ? arg1 < arg2 : arg1 == arg2;
+                    write(arg3, result);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty())
+                        throw std::runtime_error("program needs more input");
+                    write(eval_write_operand(read(pc + 1), mode1), input.front());
+                    input.pop_front();
+                    pc += 2;
+                    break;
+                }
+                case Opcode::output: {
+                    output.push_back(eval_read_operand(read(pc + 1), mode1));
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true:
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(read(pc + 1), mode1);
+                    auto arg2 = eval_read_operand(read(pc + 2), mode2);
+                    pc = (arg1 != 0) == (opcode == Opcode::jump_true) ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    relative_base += eval_read_operand(read(pc + 1), mode1);
+                    pc += 2;
+                    break;
+                }
+                default:
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, word));
+            }
+        }
+    }
+};
+
+std::vector<code> parse_codes(std::string_view text) {
+    std::vector<code> codes{};
+    std::istringstream stream{std::string(text)};
+    for (std::string part; std::getline(stream, part, ',');)
+        codes.push_back(std::stol(part));
+    return codes;
+}
+
+std::string read_file(const std::string &path) {
+    std::ifstream file(path);
+    if (!file)
+        throw std::runtime_error(std::format("cannot open {}", path));
+    return std::string(std::istreambuf_iterator<char>(file), {});
+}
+
+/**
+ * Compiles each source both ways, runs both programs on `inputs` and prints
+ * their sizes and executed instruction counts. Returns false if any pair of
+ * programs disagrees on its outputs.
+ */
+bool compare(const std::vector<std::string> &paths, const std::vector<code> &inputs) {
+    std::cout << std::format("{:<24} {:>8} {:>8} {:>12} {:>12} {:>8}", "program", "words", "naive", "instrs", "naive", "ratio") << std::endl;
+    bool agree = true;
+    for (auto &path : paths) {
+        auto source = read_file(path);
+        auto optimized = compile(source, true);
+        auto naive = compile(source, false);
+        Computer fast(optimized), slow(naive);
+        std::deque<code> input(inputs.begin(), inputs.end());
+        auto fast_output = fast.run(input);
+        auto slow_output = slow.run(input);
+        if (fast_output != slow_output) {
+            std::cerr << std::format("{}: optimized and naive outputs differ", path) << std::endl;
+            agree = false;
+        }
+        auto ratio = static_cast<double>(slow.executed) / static_cast<double>(fast.executed);
+        std::cout << std::format("{:<24} {:>8} {:>8} {:>12} {:>12} {:>7.2f}x", path, optimized.size(), naive.size(), fast.executed, slow.executed, ratio) << std::endl;
+    }
+    return agree;
+}
+
+/**
+ * Usage: compiler [--naive] SOURCE
+ *        compiler --compare [--input A,B,...] SOURCE...
+ *
+ * Compiles SOURCE to an Intcode program on stdout, in the comma-separated form
+ * Program::parse reads. Functions follow the relative-base calling convention,
+ * so runner --memoize can cache pure calls. --naive turns off the
+ * optimizations: folding, dead code elimination, immediate operands, results
+ * computed in place and slot reuse.
+ *
+ * --compare compiles every SOURCE both ways, runs each program on the given
+ * inputs and reports program size and executed instructions.
+ */
+int main(int argc, char **argv) {
+    bool naive = false;
+    bool comparing = false;
+    std::vector<code> inputs{};
+    std::vector<std::string> paths{};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--naive") {
+            naive = true;
+        } else if (arg == "--compare") {
+            comparing = true;
+        } else if (arg == "--input" && i + 1 < argc) {
+            inputs = parse_codes(argv[++i]);
+        } else if (!arg.starts_with("--")) {
+            paths.push_back(arg);
+        } else {
+            std::cerr << std::format("unknown argument {}", arg) << std::endl;
+            return 2;
+        }
+    }
+    if (paths.empty() || (!comparing && (paths.size() > 1 || !inputs.empty())) || (comparing && naive)) {
+        std::cerr << "usage: compiler [--naive] SOURCE\n"
+                     "       compiler --compare [--input A,B,...] SOURCE..."
+                  << std::endl;
+        return 2;
+    }
+
+    try {
+        if (comparing)
+            return compare(paths, inputs) ? 0 : 1;
+        auto program = compile(read_file(paths[0]), !naive);
+        for (std::size_t i = 0; i < program.size(); i++)
+            std::cout << (i ? "," : "") << program[i];
+        std::cout << std::endl;
+    } catch (std::exception &e) {
+        std::cerr << std::format("compiler: {}", e.what()) << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <format>
 #include <fstream>
+#include <memory>
+#include <memory_resource>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -10,10 +15,59 @@ const int ADD_CODE = 1;
 const int MUL_CODE = 2;
 const int HALT_CODE = 99;
 
-typedef std::vector<int> program;
+/**
+ * Bump allocator for search loops. Blocks are kept when the arena is reset, so
+ * once the largest iteration has been seen a loop that resets it every
+ * iteration never calls malloc again. Deallocation is a no-op.
+ */
+class Arena : public std::pmr::memory_resource {
+  private:
+    std::vector<std::tuple<std::unique_ptr<std::byte[]>, std::size_t>> blocks{};
+    std::size_t block = 0;
+    std::size_t offset = 0;
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        while (true) {
+            if (block == blocks.size()) {
+                auto size = std::max<std::size_t>(bytes + alignment, blocks.empty() ? 1 << 16 : 2 * std::get<1>(blocks.back()));
+                blocks.push_back({std::make_unique<std::byte[]>(size), size});
+            }
+            auto &[data, size] = blocks[block];
+            auto start = (offset + alignment - 1) & ~(alignment - 1);
+            auto base = reinterpret_cast<std::uintptr_t>(data.get());
+            start = ((base + start + alignment - 1) & ~(alignment - 1)) - base;
+            if (start + bytes <= size) {
+                offset = start + bytes;
+                return data.get() + start;
+            }
+            block++;
+            offset = 0;
+        }
+    }
+    void do_deallocate(void *, std::size_t, std::size_t) override {
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+  public:
+    /**
+     * Frees everything allocated since the last reset. Nothing allocated from
+     * the arena may be used afterwards.
+     */
+    void reset() {
+        block = 0;
+        offset = 0;
+    }
+};
+
+// Each search thread resets its own arena between iterations.
+thread_local Arena search_arena{};
+
+typedef std::pmr::vector<int> program;
 
 program parse_program(std::istream &input_stream) {
-    std::vector<int> program{};
+    program program{};
     for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
         auto opcode = std::stoi(opcode_s);
         program.push_back(opcode);
@@ -56,13 +110,15 @@ void part2(program program) {
     int solution;
     for (int noun = 0; noun < 100; noun++) {
         for (int verb = 0; verb < 100; verb++) {
-            auto clone = program;
             int result;
             try {
+                ::program clone(program, &search_arena);
                 result = execute_program(clone, {noun, verb});
             } catch (std::invalid_argument) {
+                search_arena.reset();
                 continue;
             }
+            search_arena.reset();
             if (result == 19690720) {
                 solution = 100 * noun + verb;
                 break;
@@ -1,10 +1,24 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <format>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <sys/mman.h>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
 #include <vector>
 
 enum class Opcode {
@@ -16,25 +30,179 @@ enum class Opcode {
     jump_false = 6,
     less_than = 7,
     equals = 8,
+    relative_base = 9,
     halt = 99,
 };
 
 enum class ParamMode {
     position = 0,
     immediate = 1,
+    relative = 2,
 };
 
+typedef long code;
+
+/**
+ * Raised when the program touches an address outside of its memory, i.e. not
+ * in [0, 2^31).
+ */
+class MemoryFault : public std::out_of_range {
+  public:
+    code address;
+    MemoryFault(code address) : std::out_of_range(std::format("memory fault at address {}", address)), address(address) {};
+};
+
+/**
+ * Memory is one anonymous mapping, zero-filled on demand by the kernel, that
+ * covers addresses [0, capacity). A write past it moves the mapping to a
+ * larger one with mremap, which carries the page tables over, so nothing is
+ * copied and untouched pages stay uncommitted. Reads and writes inside the
+ * mapping are plain loads and stores behind one unsigned compare, which also
+ * turns away negative addresses; reads past it are zeroes.
+ *
+ * This class is pasted verbatim into every tool that keeps Intcode memory in
+ * a mapping; keep the copies identical.
+ */
 class Program {
+  private:
+    // Smallest mapping, so that most programs never grow.
+    static constexpr std::size_t MIN_CAPACITY = std::size_t{1} << 16;
+    // Below this many bytes, clearing memory is cheaper than a madvise call.
+    static constexpr std::ptrdiff_t DISCARD_BYTES = 64 << 10;
+
+    code *memory = nullptr;
+    // Words mapped at `memory`, a power of two.
+    std::size_t capacity = 0;
+    // One past the highest address written, so copies know what to clone.
+    std::size_t extent = 0;
+
+    static std::size_t capacity_for(std::size_t words) {
+        return std::max(MIN_CAPACITY, std::bit_ceil(words));
+    }
+    [[gnu::cold]] code read_outside(code index) const {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        return 0;
+    }
+    [[gnu::cold]] void grow(code index) {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        reserve(index + 1);
+    }
+
   public:
-    std::vector<int> memory;
+    // Addresses are [0, WORDS).
+    static constexpr std::size_t WORDS = std::size_t{1} << 31;
+
+    /**
+     * A program of `extent` zero words.
+     */
+    explicit Program(std::size_t extent) : capacity(capacity_for(extent)), extent(extent) {
+        auto region = mmap(nullptr, capacity * sizeof(code), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping intcode memory");
+        memory = static_cast<code *>(region);
+    }
+    Program(const std::vector<code> &image) : Program(image.size()) {
+        std::memcpy(memory, image.data(), image.size() * sizeof(code));
+    }
     static Program parse(std::istream &input_stream) {
-        std::vector<int> program{};
+        std::vector<code> program{};
         for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
-            auto opcode = std::stoi(opcode_s);
+            auto opcode = std::stol(opcode_s);
             program.push_back(opcode);
         }
         return Program(program);
     }
+    Program(const Program &other) : Program(other.extent) {
+        std::memcpy(memory, other.memory, extent * sizeof(code));
+    }
+    Program(Program &&other) noexcept : memory(other.memory), capacity(other.capacity), extent(other.extent) {
+        other.memory = nullptr;
+    }
+    Program &operator=(Program other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(capacity, other.capacity);
+        std::swap(extent, other.extent);
+        return *this;
+    }
+    ~Program() {
+        if (memory)
+            munmap(memory, capacity * sizeof(code));
+    }
+
+    code read(code index) const {
+        if (static_cast<uint64_t>(index) < capacity) [[likely]]
+            return memory[index];
+        return read_outside(index);
+    }
+    void write(code index, code value) {
+        if (static_cast<uint64_t>(index) >= capacity) [[unlikely]]
+            grow(index);
+        memory[index] = value;
+        extent = std::max(extent, static_cast<std::size_t>(index) + 1);
+    }
+
+    std::size_t size() const {
+        return extent;
+    }
+    code *data() {
+        return memory;
+    }
+    const code *data() const {
+        return memory;
+    }
+
+    /**
+     * Maps at least `words` words. Growing may move the mapping, which
+     * invalidates pointers from data().
+     */
+    void reserve(std::size_t words) {
+        if (words <= capacity)
+            return;
+        auto bigger = capacity_for(words);
+        auto region = mremap(memory, capacity * sizeof(code), bigger * sizeof(code), MREMAP_MAYMOVE);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "growing intcode memory");
+        memory = static_cast<code *>(region);
+        capacity = bigger;
+    }
+
+    /**
+     * Makes this program's memory equal to `image` again without remapping:
+     * the image is copied back in and whatever was written past its end is
+     * cleared.
+     */
+    void reset(const Program &image) {
+        reserve(image.extent);
+        std::memcpy(memory, image.memory, image.extent * sizeof(code));
+        if (extent > image.extent)
+            clear(image.extent, extent);
+        extent = image.extent;
+    }
+
+    /**
+     * Zeroes words [from, to). Short ranges are overwritten; in longer ones
+     * the whole pages are handed back to the kernel, so the cost follows the
+     * pages actually touched rather than the range: a run that wrote one word
+     * at a high address leaves gigabytes below it that were never faulted in,
+     * and writing zeroes over them would commit them all.
+     */
+    void clear(std::size_t from, std::size_t to) {
+        static const auto page_bytes = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<char *>(memory + from);
+        auto end = reinterpret_cast<char *>(memory + to);
+        auto first = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(begin) + page_bytes - 1) & ~(page_bytes - 1));
+        auto last = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(end) & ~(page_bytes - 1));
+        if (last - first < DISCARD_BYTES) {
+            std::memset(begin, 0, end - begin);
+            return;
+        }
+        std::memset(begin, 0, first - begin);
+        std::memset(last, 0, end - last);
+        if (madvise(first, last - first, MADV_DONTNEED) != 0)
+            throw std::system_error(errno, std::generic_category(), "discarding intcode memory");
+    }
 };
 
 class Instruction {
@@ -43,122 +211,321 @@ class Instruction {
     ParamMode mode1;
     ParamMode mode2;
     ParamMode mode3;
-    static Instruction parse(int x) {
+    static Instruction parse(code x) {
         return Instruction(Opcode(x % 100), ParamMode((x / 100) % 10), ParamMode((x / 1000) % 10), ParamMode((x / 10000) % 10));
     };
 };
 
-int eval_argument(Program &p, int parameter, ParamMode mode) {
-    switch (mode) {
-        case ParamMode::position:
-            return p.memory[parameter];
-        case ParamMode::immediate:
-            return parameter;
-        default:
-            throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+class Computer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+    code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return p.read(parameter);
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return p.read(relative_base + parameter);
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return parameter;
+            case ParamMode::relative:
+                return relative_base + parameter;
+            case ParamMode::immediate:
+                throw std::invalid_argument("write operands cannot be in immediate mode");
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
     }
-}
 
-int computer(Program p) {
-    int pc = 0;
+  public:
+    Computer(Program p) : p(std::move(p)) {};
 
-    while (true) {
-        std::fprintf(stderr, "executing opcode memory[%d]=%d\n", pc, p.memory[pc]);
-        assert(pc < p.memory.size());
-        auto in = Instruction::parse(p.memory[pc]);
+    /**
+     * Takes an input and executes until another input is expected or the program
+     * halts. Returns a tuple containing the output so far and whether the computer
+     * halted.
+     */
+    std::tuple<std::deque<code>, bool> run(std::deque<code> &input) {
+        assert(!halted);
+        std::deque<code> output{};
 
-        switch (in.opcode) {
-            case Opcode::halt: {
-                goto terminate;
-            }
-            case Opcode::add: {
-                auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                auto arg3 = p.memory[pc + 3];
-                std::fprintf(stderr, "    *%d = %d + %d\n", arg3, arg1, arg2);
-                p.memory[arg3] = arg1 + arg2;
-                pc += 4;
-                break;
-            }
-            case Opcode::mul: {
-                auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                auto arg3 = p.memory[pc + 3];
-                std::fprintf(stderr, "    *%d = %d * %d\n", arg3, arg1, arg2);
-                p.memory[arg3] = arg1 * arg2;
-                pc += 4;
-                break;
-            }
-            case Opcode::input: {
-                auto arg1 = p.memory[pc + 1];
-                std::printf("Awaiting your input: ");
-                std::string input;
-                std::getline(std::cin, input);
-                auto arg2 = std::stoi(input);
-                std::fprintf(stderr, "    *%d = %d\n", arg1, arg2);
-                p.memory[arg1] = arg2;
-                pc += 2;
-                break;
-            }
-            case Opcode::output: {
-                auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                std::fprintf(stderr, "    print(%d)\n", arg1);
-                std::printf("Writing output: %d\n", arg1);
-                pc += 2;
-                break;
-            }
-            case Opcode::jump_true: {
-                auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                std::fprintf(stderr, "    pc = %d ? %d : pc+3\n", arg1, arg2);
-                pc = arg1 != 0 ? arg2 : pc + 3;
-                break;
-            }
-            case Opcode::jump_false: {
-                auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                std::fprintf(stderr, "    pc = !%d ? %d : pc+3\n", arg1, arg2);
-                pc = arg1 == 0 ? arg2 : pc + 3;
-                break;
-            }
-            case Opcode::less_than: {
-                auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                auto arg3 = p.memory[pc + 3];
-                std::fprintf(stderr, "    *%d = %d < %d\n", arg3, arg1, arg2);
-                p.memory[arg3] = arg1 < arg2 ? 1 : 0;
-                pc += 4;
-                break;
+        while (true) {
+            auto in = Instruction::parse(p.read(pc));
+
+            switch (in.opcode) {
+                case Opcode::halt: {
+                    halted = true;
+                    return {output, true};
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 + arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 * arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty())
+                        return {output, false};
+                    auto arg1 = eval_write_operand(p.read(pc + 1), in.mode1);
+                    p.write(arg1, input.front());
+                    pc += 2;
+                    input.pop_front();
+                    break;
+                }
+                case Opcode::output: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    output.push_back(arg1);
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 != 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 == 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 < arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 == arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    relative_base += arg1;
+                    pc += 2;
+                    break;
+                }
+                default: {
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.read(pc)));
+                }
             }
-            case Opcode::equals: {
-                auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                auto arg3 = p.memory[pc + 3];
-                std::fprintf(stderr, "    *%d = %d == %d\n", arg3, arg1, arg2);
-                p.memory[arg3] = arg1 == arg2 ? 1 : 0;
-                pc += 4;
-                break;
+        }
+    }
+};
+
+/**
+ * Runs `program` to completion on the given inputs and returns its outputs.
+ * Fails if the program asks for more inputs than there are.
+ */
+std::deque<code> run_to_halt(const Program &program, std::deque<code> input) {
+    auto given = input.size();
+    auto computer = Computer(program);
+    auto [output, halted] = computer.run(input);
+    if (!halted)
+        throw std::runtime_error(std::format("program needs more than the {} inputs given", given));
+    return output;
+}
+
+/**
+ * Runs the diagnostic program for system `id`. Every output but the last is
+ * the result of one test, 0 when it passed; the last is the diagnostic code.
+ * Returns the code, or what went wrong.
+ */
+std::string diagnose(const Program &program, code id) {
+    try {
+        auto output = run_to_halt(program, {id});
+        if (output.empty())
+            return "error: no diagnostic code";
+        std::string failed{};
+        for (std::size_t i = 0; i + 1 < output.size(); i++) {
+            if (output[i] != 0)
+                failed += std::format("{}{}", failed.empty() ? "" : ",", i);
+        }
+        if (!failed.empty())
+            return std::format("error: tests {} failed", failed);
+        return std::to_string(output.back());
+    } catch (std::exception &e) {
+        return std::format("error: {}", e.what());
+    }
+}
+
+const code SUITE[] = {1, 5};
+
+/**
+ * Runs the diagnostics of SUITE for every program, as independent tasks
+ * spread over `threads` threads, and writes one line per program, in order.
+ * Each task loads its program and drops it when done, so there are never more
+ * programs in memory than threads however many paths are given. Returns
+ * whether all of them produced a diagnostic code.
+ */
+bool suite(const std::vector<std::string> &paths, unsigned threads) {
+    const auto ids = std::size(SUITE);
+    std::vector<std::string> results(paths.size() * ids);
+    std::atomic<std::size_t> next = 0;
+    auto work = [&] {
+        for (std::size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < paths.size();) {
+            auto result = &results[i * ids];
+            try {
+                std::ifstream file(paths[i]);
+                if (!file)
+                    throw std::runtime_error("cannot open");
+                auto program = Program::parse(file);
+                for (std::size_t j = 0; j < ids; j++)
+                    result[j] = diagnose(program, SUITE[j]);
+            } catch (std::exception &e) {
+                std::fill(result, result + ids, std::format("error: {}", e.what()));
             }
-            default: {
-                throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.memory[pc]));
+        }
+    };
+    std::vector<std::thread> pool{};
+    for (unsigned t = 1; t < std::min<std::size_t>(threads, paths.size()); t++)
+        pool.emplace_back(work);
+    work();
+    for (auto &thread : pool)
+        thread.join();
+
+    std::string out{};
+    bool ok = true;
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        out += paths[i] + ":";
+        for (std::size_t j = 0; j < ids; j++) {
+            auto &result = results[i * ids + j];
+            ok &= !result.starts_with("error");
+            out += std::format(" {}={}", SUITE[j], result);
+        }
+        out += '\n';
+    }
+    std::cout.write(out.data(), out.size());
+    return ok;
+}
+
+/**
+ * Reads inputs separated by commas or whitespace.
+ */
+std::deque<code> parse_inputs(std::istream &stream) {
+    std::deque<code> input{};
+    for (std::string word; stream >> word;) {
+        std::istringstream parts(word);
+        for (std::string part; std::getline(parts, part, ',');) {
+            if (!part.empty())
+                input.push_back(std::stol(part));
+        }
+    }
+    return input;
+}
+
+/**
+ * Usage: day05 [--input A,B,... | --input-file PATH] [PROGRAM]
+ *        day05 --suite [--threads N] PROGRAM...
+ *
+ * Prints the diagnostic codes of PROGRAM (default inputs/day05.txt) for the
+ * air conditioner (system ID 1, part 1) and the thermal radiator controller
+ * (system ID 5, part 2).
+ *
+ * --input and --input-file run PROGRAM (default inputs/day05.txt) once on the
+ * given inputs, which are all queued before it starts, and print its outputs
+ * on one line, comma-separated.
+ *
+ * --suite runs both diagnostics for every PROGRAM on N threads (default: one
+ * per CPU) and prints "PROGRAM: 1=CODE 5=CODE" per program, or the error in
+ * place of a code, e.g. the tests that did not output 0. Exits with 1 when
+ * any diagnostic fails.
+ */
+int main(int argc, char **argv) {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool run_suite = false;
+    std::optional<std::deque<code>> input{};
+    std::vector<std::string> paths{};
+    auto usage = [] {
+        std::cerr << "usage: day05 [--input A,B,... | --input-file PATH] [PROGRAM]\n"
+                     "       day05 --suite [--threads N] PROGRAM..."
+                  << std::endl;
+        return 2;
+    };
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--input" && i + 1 < argc) {
+                std::istringstream stream(argv[++i]);
+                input = parse_inputs(stream);
+            } else if (arg == "--input-file" && i + 1 < argc) {
+                std::ifstream file(argv[++i]);
+                if (!file) {
+                    std::cerr << std::format("cannot open {}", argv[i]) << std::endl;
+                    return 2;
+                }
+                input = parse_inputs(file);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                threads = std::max(1, std::stoi(argv[++i]));
+            } else if (arg == "--suite") {
+                run_suite = true;
+            } else if (!arg.starts_with("--")) {
+                paths.push_back(arg);
+            } else {
+                std::cerr << std::format("unknown argument {}", arg) << std::endl;
+                return 2;
             }
         }
+    } catch (std::exception &) {
+        return usage();
     }
-terminate:
-    return p.memory[0];
-};
+    if (run_suite ? paths.empty() || input : paths.size() > 1)
+        return usage();
+    if (run_suite)
+        return suite(paths, threads) ? 0 : 1;
+    if (paths.empty())
+        paths.push_back("inputs/day05.txt");
 
-// clang-format off
-const std::string TEST_INPUT = "3,21,1008,21,8,20,1005,20,22,107,8,21,20,1006,20,31,1106,0,36,98,0,0,1002,21,125,20,4,20,1105,1,46,104,999,1105,1,46,1101,1000,1,20,4,20,1105,1,46,98,99";
-// clang-format on
+    std::ifstream file(paths[0]);
+    if (!file) {
+        std::cerr << std::format("cannot open {}", paths[0]) << std::endl;
+        return 2;
+    }
+    auto program = Program::parse(file);
 
-int main() {
-    std::ifstream real_input("inputs/day05.txt");
-    std::istringstream test_input{TEST_INPUT};
-    auto input = &real_input;
+    if (input) {
+        try {
+            auto output = run_to_halt(program, *input);
+            std::string out{};
+            for (auto x : output)
+                out += std::format("{}{}", out.empty() ? "" : ",", x);
+            std::cout << out << std::endl;
+        } catch (std::exception &e) {
+            std::cerr << std::format("day05: {}", e.what()) << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-    Program program = Program::parse(*input);
-    computer(program);
+    std::cout << std::format("Part 1: {}\n", diagnose(program, SUITE[0]));
+    std::cout << std::format("Part 2: {}\n", diagnose(program, SUITE[1]));
 
     return 0;
 }
@@ -1,15 +1,58 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <deque>
 #include <format>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <pthread.h>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+// Every heap allocation in the process goes through here, aligned ones
+// included, so the bench can check that searches stay off the heap.
+std::atomic<uint64_t> allocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    // aligned_alloc wants a nonzero multiple of the alignment.
+    auto align = static_cast<std::size_t>(alignment);
+    if (auto p = std::aligned_alloc(align, (std::max(size, std::size_t{1}) + align - 1) & ~(align - 1)))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
 enum class Opcode {
     add = 1,
     mul = 2,
@@ -27,11 +70,67 @@ enum class ParamMode {
     immediate = 1,
 };
 
+/**
+ * Bump allocator for search loops. Blocks are kept when the arena is reset, so
+ * once the largest iteration has been seen a loop that resets it every
+ * iteration never calls malloc again. Deallocation is a no-op.
+ */
+class Arena : public std::pmr::memory_resource {
+  private:
+    std::vector<std::tuple<std::unique_ptr<std::byte[]>, std::size_t>> blocks{};
+    std::size_t block = 0;
+    std::size_t offset = 0;
+
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override {
+        while (true) {
+            if (block == blocks.size()) {
+                auto size = std::max<std::size_t>(bytes + alignment, blocks.empty() ? 1 << 16 : 2 * std::get<1>(blocks.back()));
+                blocks.push_back({std::make_unique<std::byte[]>(size), size});
+            }
+            auto &[data, size] = blocks[block];
+            auto start = (offset + alignment - 1) & ~(alignment - 1);
+            auto base = reinterpret_cast<std::uintptr_t>(data.get());
+            start = ((base + start + alignment - 1) & ~(alignment - 1)) - base;
+            if (start + bytes <= size) {
+                offset = start + bytes;
+                return data.get() + start;
+            }
+            block++;
+            offset = 0;
+        }
+    }
+    void do_deallocate(void *, std::size_t, std::size_t) override {
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        return this == &other;
+    }
+
+  public:
+    /**
+     * Frees everything allocated since the last reset. Nothing allocated from
+     * the arena may be used afterwards.
+     */
+    void reset() {
+        block = 0;
+        offset = 0;
+    }
+};
+
+// Each search thread resets its own arena between iterations.
+thread_local Arena search_arena{};
+
 class Program {
   public:
-    std::vector<int> memory;
+    std::pmr::vector<int> memory;
+    Program(std::pmr::vector<int> memory) : memory(std::move(memory)) {};
+    Program(const Program &other) = default;
+    /**
+     * Copies `other`, allocating the copy's memory from `resource`.
+     */
+    Program(const Program &other, std::pmr::memory_resource *resource) : memory(other.memory, resource) {};
+
     static Program parse(std::istream &input_stream) {
-        std::vector<int> program{};
+        std::pmr::vector<int> program{};
         for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
             auto opcode = std::stoi(opcode_s);
             program.push_back(opcode);
@@ -67,40 +166,51 @@ class Computer {
     Program p;
     int pc = 0;
     bool halted = false;
+    bool trace;
+    std::pmr::memory_resource *resource;
 
   public:
-    Computer(Program p) : p(p) {};
+    /**
+     * Memory and I/O buffers are allocated from `resource`.
+     */
+    Computer(const Program &p, bool trace = true, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : p(p, resource), trace(trace), resource(resource) {};
 
     /**
      * Takes an input and executes until another input is expected or the program
      * halts. Returns a tuple containing the output so far and whethr the computer
      * halted.
      */
-    std::tuple<std::deque<int>, bool> run(std::deque<int> &input) {
+    std::tuple<std::pmr::deque<int>, bool> run(std::pmr::deque<int> &input) {
         assert(!halted);
-        std::deque<int> output{};
+        std::pmr::deque<int> output{resource};
 
-        std::cerr << std::format("program state: pc={} memory=", pc);
-        for (auto x : p.memory)
-            std::cerr << x << " ";
-        std::cerr << std::endl;
+        if (trace) {
+            std::cerr << std::format("program state: pc={} memory=", pc);
+            for (auto x : p.memory)
+                std::cerr << x << " ";
+            std::cerr << std::endl;
+        }
 
         while (true) {
-            std::cerr << std::left << std::setw(36) << std::format("executing opcode memory[{}]={}", pc, p.memory[pc]) << " | ";
+            if (trace)
+                std::cerr << std::left << std::setw(36) << std::format("executing opcode memory[{}]={}", pc, p.memory[pc]) << " | ";
             assert(pc < p.memory.size());
             auto in = Instruction::parse(p.memory[pc]);
 
             switch (in.opcode) {
                 case Opcode::halt: {
-                    std::cerr << "halt" << std::endl;
+                    if (trace)
+                        std::cerr << "halt" << std::endl;
                     halted = true;
-                    return {output, true};
+                    return {std::move(output), true};
                 }
                 case Opcode::add: {
                     auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
                     auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
                     auto arg3 = p.memory[pc + 3];
-                    std::cerr << std::format("*{} = {} + {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} + {}", arg3, arg1, arg2) << std::endl;
                     p.memory[arg3] = arg1 + arg2;
                     pc += 4;
                     break;
@@ -109,19 +219,22 @@ class Computer {
                     auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
                     auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
                     auto arg3 = p.memory[pc + 3];
-                    std::cerr << std::format("*{} = {} * {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} * {}", arg3, arg1, arg2) << std::endl;
                     p.memory[arg3] = arg1 * arg2;
                     pc += 4;
                     break;
                 }
                 case Opcode::input: {
                     if (input.empty()) {
-                        std::cerr << "break" << std::endl;
-                        return {output, false};
+                        if (trace)
+                            std::cerr << "break" << std::endl;
+                        return {std::move(output), false};
                     }
                     auto arg1 = p.memory[pc + 1];
                     auto arg2 = input.front();
-                    std::cerr << std::format("*{} = {}", arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {}", arg1, arg2) << std::endl;
                     p.memory[arg1] = arg2;
                     pc += 2;
                     input.pop_front();
@@ -129,7 +242,8 @@ class Computer {
                 }
                 case Opcode::output: {
                     auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
-                    std::cerr << std::format("print({})", arg1) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("print({})", arg1) << std::endl;
                     output.push_back(arg1);
                     pc += 2;
                     break;
@@ -137,14 +251,16 @@ class Computer {
                 case Opcode::jump_true: {
                     auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
                     auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                    std::cerr << std::format("pc = {} ? {} : pc+3", arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("pc = {} ? {} : pc+3", arg1, arg2) << std::endl;
                     pc = arg1 != 0 ? arg2 : pc + 3;
                     break;
                 }
                 case Opcode::jump_false: {
                     auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
                     auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
-                    std::cerr << std::format("pc = !{} ? {} : pc+3", arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("pc = !{} ? {} : pc+3", arg1, arg2) << std::endl;
                     pc = arg1 == 0 ? arg2 : pc + 3;
                     break;
                 }
@@ -152,7 +268,8 @@ class Computer {
                     auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
                     auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
                     auto arg3 = p.memory[pc + 3];
-                    std::cerr << std::format("*{} = {} < {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} < {}", arg3, arg1, arg2) << std::endl;
                     p.memory[arg3] = arg1 < arg2 ? 1 : 0;
                     pc += 4;
                     break;
@@ -161,7 +278,8 @@ class Computer {
                     auto arg1 = eval_argument(p, p.memory[pc + 1], in.mode1);
                     auto arg2 = eval_argument(p, p.memory[pc + 2], in.mode2);
                     auto arg3 = p.memory[pc + 3];
-                    std::cerr << std::format("*{} = {} == {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} == {}", arg3, arg1, arg2) << std::endl;
                     p.memory[arg3] = arg1 == arg2 ? 1 : 0;
                     pc += 4;
                     break;
@@ -178,63 +296,264 @@ void part1(Program program) {
     std::vector<int> signals{0, 1, 2, 3, 4};
     int largest_thruster{0};
     do {
-        std::array<Computer, 5> amps{{Computer(program), Computer(program), Computer(program), Computer(program), Computer(program)}};
-        std::deque<int> prev_amp_out{0};
-        for (auto i = 0; i < 5; i++) {
-            auto amp = &amps[i];
-            auto amp_in = prev_amp_out;
-            amp_in.push_front(signals[i]);
-            auto [out, halted] = amp->run(amp_in);
-            prev_amp_out = out;
+        {
+            std::pmr::memory_resource *arena = &search_arena;
+            auto make = [&] { return Computer(program, true, arena); };
+            std::array<Computer, 5> amps{{make(), make(), make(), make(), make()}};
+            std::pmr::deque<int> prev_amp_out(arena);
+            prev_amp_out.push_back(0);
+            for (auto i = 0; i < 5; i++) {
+                auto amp = &amps[i];
+                std::pmr::deque<int> amp_in(prev_amp_out, arena);
+                amp_in.push_front(signals[i]);
+                auto [out, halted] = amp->run(amp_in);
+                prev_amp_out = out;
+            }
+            largest_thruster = std::max(largest_thruster, prev_amp_out[0]);
         }
-        largest_thruster = std::max(largest_thruster, prev_amp_out[0]);
+        search_arena.reset();
     } while (std::next_permutation(signals.begin(), signals.end()));
 
     std::cout << std::format("Part 1: {}\n", largest_thruster);
 };
 
-void part2(Program program) {
-    std::vector<int> signals{5, 6, 7, 8, 9};
-    int largest_thruster{0};
-    do {
-        std::array<Computer, 5> amps{{Computer(program), Computer(program), Computer(program), Computer(program), Computer(program)}};
-        std::array<std::deque<int>, 5> inputs{{{signals[0], 0}, {signals[1]}, {signals[2]}, {signals[3]}, {signals[4]}}};
-        int thruster;
-        while (true) {
-            for (auto i = 0; i < 5; i++) {
-                assert(!inputs[i].empty());
+/**
+ * Runs the five amps of one feedback loop round-robin on the calling thread.
+ */
+int feedback_round_robin(const Program &program, const std::vector<int> &signals, bool trace, std::pmr::memory_resource *resource) {
+    std::array<Computer, 5> amps{{Computer(program, trace, resource),
+                                  Computer(program, trace, resource),
+                                  Computer(program, trace, resource),
+                                  Computer(program, trace, resource),
+                                  Computer(program, trace, resource)}};
+    std::array<std::pmr::deque<int>, 5> inputs{{std::pmr::deque<int>({signals[0], 0}, resource),
+                                                std::pmr::deque<int>({signals[1]}, resource),
+                                                std::pmr::deque<int>({signals[2]}, resource),
+                                                std::pmr::deque<int>({signals[3]}, resource),
+                                                std::pmr::deque<int>({signals[4]}, resource)}};
+    while (true) {
+        for (auto i = 0; i < 5; i++) {
+            assert(!inputs[i].empty());
+            if (trace) {
                 std::cerr << std::format("running amp {} with inputs ", i);
                 for (auto x : inputs[i])
                     std::cerr << x << " ";
                 std::cerr << std::endl;
-                auto amp = &amps[i];
-                auto [out, halted] = amp->run(inputs[i]);
-                auto next_input = &inputs[(i + 1) % 5];
-                for (auto x : out)
-                    next_input->push_back(x);
-                if (i == 4 && halted) {
-                    thruster = out[0];
-                    goto end;
-                }
             }
+            auto amp = &amps[i];
+            auto [out, halted] = amp->run(inputs[i]);
+            auto next_input = &inputs[(i + 1) % 5];
+            for (auto x : out)
+                next_input->push_back(x);
+            if (i == 4 && halted)
+                return out[0];
         }
-    end:
-        largest_thruster = std::max(largest_thruster, thruster);
+    }
+}
+
+void part2(Program program) {
+    std::vector<int> signals{5, 6, 7, 8, 9};
+    int largest_thruster{0};
+    do {
+        largest_thruster = std::max(largest_thruster, feedback_round_robin(program, signals, true, &search_arena));
+        search_arena.reset();
     } while (std::next_permutation(signals.begin(), signals.end()));
 
     std::cout << std::format("Part 2: {}", largest_thruster) << std::endl;
 };
 
+/**
+ * How a blocked channel endpoint waits: busy-poll, poll with sched_yield, or
+ * sleep in the kernel on a futex (std::atomic::wait). Spinning only pays off
+ * when every amp has a core of its own.
+ */
+enum class WaitStrategy { spin, yield, futex };
+
+/**
+ * Bounded single-producer single-consumer queue connecting two amps.
+ */
+class Channel {
+  private:
+    static constexpr uint32_t CAPACITY = 64;
+    std::array<int, CAPACITY> ring;
+    alignas(64) std::atomic<uint32_t> head = 0;
+    alignas(64) std::atomic<uint32_t> tail = 0;
+    WaitStrategy wait;
+
+    void await_change(std::atomic<uint32_t> &index, uint32_t seen) {
+        switch (wait) {
+            case WaitStrategy::spin:
+                // Give the core away now and then, or an oversubscribed machine
+                // only makes progress once per scheduler tick.
+                for (uint32_t polls = 1; index.load(std::memory_order_acquire) == seen; polls++) {
+                    __builtin_ia32_pause();
+                    if (polls % 4096 == 0)
+                        std::this_thread::yield();
+                }
+                break;
+            case WaitStrategy::yield:
+                while (index.load(std::memory_order_acquire) == seen)
+                    std::this_thread::yield();
+                break;
+            case WaitStrategy::futex:
+                index.wait(seen, std::memory_order_acquire);
+                break;
+        }
+    }
+
+  public:
+    Channel(WaitStrategy wait) : wait(wait) {};
+
+    void push(int x) {
+        auto h = head.load(std::memory_order_relaxed);
+        for (uint32_t t; h - (t = tail.load(std::memory_order_acquire)) == CAPACITY;)
+            await_change(tail, t);
+        ring[h % CAPACITY] = x;
+        head.store(h + 1, std::memory_order_release);
+        if (wait == WaitStrategy::futex)
+            head.notify_one();
+    }
+    int pop() {
+        auto t = tail.load(std::memory_order_relaxed);
+        while (head.load(std::memory_order_acquire) == t)
+            await_change(head, t);
+        auto x = ring[t % CAPACITY];
+        tail.store(t + 1, std::memory_order_release);
+        if (wait == WaitStrategy::futex)
+            tail.notify_one();
+        return x;
+    }
+};
+
+void pin_to_cpu(std::thread &thread, unsigned cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+}
+
+/**
+ * Runs every feedback loop in `permutations` with each amp on its own pinned
+ * thread, connected by channels, so the loop executes as a real pipeline.
+ * The threads live across permutations: channels are FIFO, so consecutive
+ * loops simply follow each other through the pipe. Returns the thruster
+ * signal of every permutation.
+ */
+std::vector<int> feedback_pipelined(const Program &program, const std::vector<std::vector<int>> &permutations, WaitStrategy wait) {
+    // channels[i] feeds amp i.
+    std::array<Channel, 5> channels{{Channel(wait), Channel(wait), Channel(wait), Channel(wait), Channel(wait)}};
+    std::vector<int> thrusters{};
+    std::vector<std::thread> threads{};
+    for (auto i = 0; i < 5; i++) {
+        threads.emplace_back([&, i] {
+            for (auto &signals : permutations) {
+                auto amp = Computer(program, false, &search_arena);
+                std::pmr::deque<int> input({signals[i]}, &search_arena);
+                if (i == 0)
+                    input.push_back(0);
+                while (true) {
+                    auto [out, halted] = amp.run(input);
+                    // The last amp's final output is the thruster signal; amp 0
+                    // has already halted and must not see it.
+                    if (i == 4 && halted) {
+                        thrusters.push_back(out.back());
+                        break;
+                    }
+                    for (auto x : out)
+                        channels[(i + 1) % 5].push(x);
+                    if (halted)
+                        break;
+                    input.push_back(channels[i].pop());
+                }
+                search_arena.reset();
+            }
+        });
+        pin_to_cpu(threads.back(), i);
+    }
+    for (auto &thread : threads)
+        thread.join();
+    return thrusters;
+}
+
+void part2_pipelined(Program program, WaitStrategy wait) {
+    std::vector<int> signals{5, 6, 7, 8, 9};
+    std::vector<std::vector<int>> permutations{};
+    do {
+        permutations.push_back(signals);
+    } while (std::next_permutation(signals.begin(), signals.end()));
+
+    auto thrusters = feedback_pipelined(program, permutations, wait);
+    std::cout << std::format("Part 2: {}", *std::max_element(thrusters.begin(), thrusters.end())) << std::endl;
+}
+
+/**
+ * Compares the per-feedback-loop latency of the round-robin driver against the
+ * pipelined driver under each wait strategy, with tracing disabled.
+ */
+void bench(Program program, int rounds) {
+    std::vector<int> signals{5, 6, 7, 8, 9};
+    std::vector<std::vector<int>> permutations{};
+    do {
+        permutations.push_back(signals);
+    } while (std::next_permutation(signals.begin(), signals.end()));
+    auto loops = rounds * permutations.size();
+
+    // One loop sizes the arena; after that the round-robin driver must not
+    // touch the heap at all.
+    feedback_round_robin(program, permutations[0], false, &search_arena);
+    search_arena.reset();
+    auto before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (auto r = 0; r < rounds; r++)
+        for (auto &p : permutations) {
+            feedback_round_robin(program, p, false, &search_arena);
+            search_arena.reset();
+        }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    auto allocated = allocations.load() - before;
+    std::cout << std::format("round-robin       {:>10.2f} us/loop, {} allocations", elapsed.count() / loops, allocated) << std::endl;
+    assert(allocated == 0);
+
+    const std::array<std::tuple<WaitStrategy, std::string>, 3> strategies{{{WaitStrategy::spin, "spin"}, {WaitStrategy::yield, "yield"}, {WaitStrategy::futex, "futex"}}};
+    for (auto &[wait, name] : strategies) {
+        auto start = std::chrono::steady_clock::now();
+        for (auto r = 0; r < rounds; r++)
+            feedback_pipelined(program, permutations, wait);
+        std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << std::format("pipelined ({:<5}) {:>10.2f} us/loop", name, elapsed.count() / loops) << std::endl;
+    }
+}
+
 // clang-format off
 const std::string TEST_INPUT = "3,26,1001,26,-4,26,3,27,1002,27,2,27,1,27,26,27,4,27,1001,28,-1,28,1005,28,6,99,0,0,5";
 // clang-format on
 
-int main() {
+/**
+ * Usage: day07 [--pipeline spin|yield|futex] [--bench [ROUNDS]]
+ */
+int main(int argc, char **argv) {
     std::ifstream real_input("inputs/day07.txt");
     std::istringstream test_input{TEST_INPUT};
     auto input = &real_input;
 
     Program program = Program::parse(*input);
+
+    if (argc >= 2 && std::string(argv[1]) == "--bench") {
+        bench(program, argc >= 3 ? std::stoi(argv[2]) : 10);
+        return 0;
+    }
+    if (argc >= 3 && std::string(argv[1]) == "--pipeline") {
+        std::string name = argv[2];
+        if (name != "spin" && name != "yield" && name != "futex") {
+            std::cerr << "usage: day07 [--pipeline spin|yield|futex] [--bench [ROUNDS]]" << std::endl;
+            return 2;
+        }
+        auto wait = name == "spin" ? WaitStrategy::spin : name == "yield" ? WaitStrategy::yield : WaitStrategy::futex;
+        part1(program);
+        part2_pipelined(program, wait);
+        return 0;
+    }
+
     part1(program);
     part2(program);
 
@@ -1,14 +1,22 @@
+#include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <deque>
 #include <format>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
 #include <vector>
 
 enum class Opcode {
@@ -32,12 +40,70 @@ enum class ParamMode {
 
 typedef long code;
 
+/**
+ * Raised when the program touches an address outside of its memory, i.e. not
+ * in [0, 2^31).
+ */
+class MemoryFault : public std::out_of_range {
+  public:
+    code address;
+    MemoryFault(code address) : std::out_of_range(std::format("memory fault at address {}", address)), address(address) {};
+};
+
+/**
+ * Memory is one anonymous mapping, zero-filled on demand by the kernel, that
+ * covers addresses [0, capacity). A write past it moves the mapping to a
+ * larger one with mremap, which carries the page tables over, so nothing is
+ * copied and untouched pages stay uncommitted. Reads and writes inside the
+ * mapping are plain loads and stores behind one unsigned compare, which also
+ * turns away negative addresses; reads past it are zeroes.
+ *
+ * This class is pasted verbatim into every tool that keeps Intcode memory in
+ * a mapping; keep the copies identical.
+ */
 class Program {
   private:
-    std::vector<code> memory;
-    Program(std::vector<code> memory) : memory(memory) {};
+    // Smallest mapping, so that most programs never grow.
+    static constexpr std::size_t MIN_CAPACITY = std::size_t{1} << 16;
+    // Below this many bytes, clearing memory is cheaper than a madvise call.
+    static constexpr std::ptrdiff_t DISCARD_BYTES = 64 << 10;
+
+    code *memory = nullptr;
+    // Words mapped at `memory`, a power of two.
+    std::size_t capacity = 0;
+    // One past the highest address written, so copies know what to clone.
+    std::size_t extent = 0;
+
+    static std::size_t capacity_for(std::size_t words) {
+        return std::max(MIN_CAPACITY, std::bit_ceil(words));
+    }
+    [[gnu::cold]] code read_outside(code index) const {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        return 0;
+    }
+    [[gnu::cold]] void grow(code index) {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        reserve(index + 1);
+    }
 
   public:
+    // Addresses are [0, WORDS).
+    static constexpr std::size_t WORDS = std::size_t{1} << 31;
+
+    /**
+     * A program of `extent` zero words.
+     */
+    explicit Program(std::size_t extent) : capacity(capacity_for(extent)), extent(extent) {
+        auto region = mmap(nullptr, capacity * sizeof(code), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping intcode memory");
+        memory = static_cast<code *>(region);
+    }
+    Program(const std::vector<code> &image) : Program(image.size()) {
+        std::memcpy(memory, image.data(), image.size() * sizeof(code));
+    }
     static Program parse(std::istream &input_stream) {
         std::vector<code> program{};
         for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
@@ -46,13 +112,94 @@ class Program {
         }
         return Program(program);
     }
-    code read(std::size_t index) {
-        return index < memory.size() ? memory[index] : 0;
+    Program(const Program &other) : Program(other.extent) {
+        std::memcpy(memory, other.memory, extent * sizeof(code));
+    }
+    Program(Program &&other) noexcept : memory(other.memory), capacity(other.capacity), extent(other.extent) {
+        other.memory = nullptr;
     }
-    void write(std::size_t index, code value) {
-        if (index >= memory.size())
-            memory.resize(index + 1);
+    Program &operator=(Program other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(capacity, other.capacity);
+        std::swap(extent, other.extent);
+        return *this;
+    }
+    ~Program() {
+        if (memory)
+            munmap(memory, capacity * sizeof(code));
+    }
+
+    code read(code index) const {
+        if (static_cast<uint64_t>(index) < capacity) [[likely]]
+            return memory[index];
+        return read_outside(index);
+    }
+    void write(code index, code value) {
+        if (static_cast<uint64_t>(index) >= capacity) [[unlikely]]
+            grow(index);
         memory[index] = value;
+        extent = std::max(extent, static_cast<std::size_t>(index) + 1);
+    }
+
+    std::size_t size() const {
+        return extent;
+    }
+    code *data() {
+        return memory;
+    }
+    const code *data() const {
+        return memory;
+    }
+
+    /**
+     * Maps at least `words` words. Growing may move the mapping, which
+     * invalidates pointers from data().
+     */
+    void reserve(std::size_t words) {
+        if (words <= capacity)
+            return;
+        auto bigger = capacity_for(words);
+        auto region = mremap(memory, capacity * sizeof(code), bigger * sizeof(code), MREMAP_MAYMOVE);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "growing intcode memory");
+        memory = static_cast<code *>(region);
+        capacity = bigger;
+    }
+
+    /**
+     * Makes this program's memory equal to `image` again without remapping:
+     * the image is copied back in and whatever was written past its end is
+     * cleared.
+     */
+    void reset(const Program &image) {
+        reserve(image.extent);
+        std::memcpy(memory, image.memory, image.extent * sizeof(code));
+        if (extent > image.extent)
+            clear(image.extent, extent);
+        extent = image.extent;
+    }
+
+    /**
+     * Zeroes words [from, to). Short ranges are overwritten; in longer ones
+     * the whole pages are handed back to the kernel, so the cost follows the
+     * pages actually touched rather than the range: a run that wrote one word
+     * at a high address leaves gigabytes below it that were never faulted in,
+     * and writing zeroes over them would commit them all.
+     */
+    void clear(std::size_t from, std::size_t to) {
+        static const auto page_bytes = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<char *>(memory + from);
+        auto end = reinterpret_cast<char *>(memory + to);
+        auto first = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(begin) + page_bytes - 1) & ~(page_bytes - 1));
+        auto last = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(end) & ~(page_bytes - 1));
+        if (last - first < DISCARD_BYTES) {
+            std::memset(begin, 0, end - begin);
+            return;
+        }
+        std::memset(begin, 0, first - begin);
+        std::memset(last, 0, end - last);
+        if (madvise(first, last - first, MADV_DONTNEED) != 0)
+            throw std::system_error(errno, std::generic_category(), "discarding intcode memory");
     }
 };
 
@@ -67,12 +214,29 @@ class Instruction {
     };
 };
 
+/**
+ * A decoded operand of an instruction that is only inspected, not executed.
+ */
+struct Operand {
+    ParamMode mode;
+    code parameter;
+    bool is_cell() const {
+        return mode != ParamMode::immediate;
+    }
+    code address(code relative_base) const {
+        return mode == ParamMode::relative ? relative_base + parameter : parameter;
+    }
+};
+
 class Computer {
   private:
     Program p;
     code pc = 0;
     code relative_base = 0;
     bool halted = false;
+    bool accelerate;
+    // Whether to print every instruction executed to stderr.
+    bool trace;
     code eval_read_operand(code parameter, ParamMode mode) {
         switch (mode) {
             case ParamMode::position:
@@ -98,8 +262,129 @@ class Computer {
         }
     }
 
+    Operand operand(code address, ParamMode mode) {
+        return Operand{mode, p.read(address)};
+    }
+
+    /**
+     * Called when the jump at `jump_pc` is about to go back to `target`. If the
+     * loop body [target, jump_pc] is a bare induction loop, i.e.
+     *
+     *     add X, c, X          (c an immediate)
+     *     lt|eq X, B, T        (optional; either operand order)
+     *     jt|jf T (or X), target
+     *
+     * then the number of remaining iterations is computed in closed form and the
+     * computer is moved straight to the state after the loop exits: X and T
+     * hold their final values and pc points past the jump. Returns false, having
+     * changed nothing, whenever the loop does not match exactly, would not
+     * terminate, would overflow, or would write over its own code.
+     */
+    bool fast_forward_loop(code target, code jump_pc) {
+        auto rb = relative_base;
+        auto loop_end = jump_pc + 3;
+
+        auto inc = Instruction::parse(p.read(target));
+        if (inc.opcode != Opcode::add || inc.mode3 == ParamMode::immediate)
+            return false;
+        auto x = operand(target + 3, inc.mode3).address(rb);
+        auto a = operand(target + 1, inc.mode1);
+        auto b = operand(target + 2, inc.mode2);
+        code step;
+        if (a.is_cell() && a.address(rb) == x && !b.is_cell())
+            step = b.parameter;
+        else if (b.is_cell() && b.address(rb) == x && !a.is_cell())
+            step = a.parameter;
+        else
+            return false;
+        if (step == 0 || (x >= target && x < loop_end))
+            return false;
+
+        auto cmp_pc = target + 4;
+        auto cmp = Instruction::parse(p.read(cmp_pc));
+        bool has_cmp = cmp.opcode == Opcode::less_than || cmp.opcode == Opcode::equals;
+        code t = x;
+        code bound = 0;
+        // Whether X is the left operand of the comparison.
+        bool x_left = true;
+        if (has_cmp) {
+            if (cmp_pc + 4 != jump_pc || cmp.mode3 == ParamMode::immediate)
+                return false;
+            t = operand(cmp_pc + 3, cmp.mode3).address(rb);
+            auto l = operand(cmp_pc + 1, cmp.mode1);
+            auto r = operand(cmp_pc + 2, cmp.mode2);
+            Operand other;
+            if (l.is_cell() && l.address(rb) == x) {
+                other = r;
+            } else if (r.is_cell() && r.address(rb) == x) {
+                other = l;
+                x_left = false;
+            } else {
+                return false;
+            }
+            if (other.is_cell() && (other.address(rb) == x || other.address(rb) == t))
+                return false;
+            if (t == x || (t >= target && t < loop_end))
+                return false;
+            bound = other.is_cell() ? p.read(other.address(rb)) : other.parameter;
+        } else if (cmp_pc != jump_pc) {
+            return false;
+        }
+
+        auto jump = Instruction::parse(p.read(jump_pc));
+        auto cond = operand(jump_pc + 1, jump.mode1);
+        auto dest = operand(jump_pc + 2, jump.mode2);
+        if (!cond.is_cell() || cond.address(rb) != t)
+            return false;
+        if (dest.is_cell() && (dest.address(rb) == x || dest.address(rb) == t))
+            return false;
+        bool while_true = jump.opcode == Opcode::jump_true;
+
+        // The jump is being taken, so X satisfies the loop condition now. Find
+        // how many more iterations run before it stops holding.
+        code value = p.read(x);
+        code iterations;
+        if (!has_cmp || cmp.opcode == Opcode::equals) {
+            // Continue while X != B (jump_true on X itself means B = 0). The
+            // other polarity exits after one iteration and isn't worth it.
+            code distance;
+            if (has_cmp == while_true || __builtin_sub_overflow(bound, value, &distance))
+                return false;
+            if (distance % step != 0 || distance / step <= 0)
+                return false;
+            iterations = distance / step;
+        } else {
+            // Normalize "X < B", "B < X" and their negations to either
+            // X <= limit (counting up) or X >= limit (counting down).
+            bool upper = x_left == while_true;
+            // X < B with B the smallest code, or B < X with it the largest,
+            // cannot hold, and B -/+ 1 below would overflow.
+            if (while_true && bound == (x_left ? std::numeric_limits<code>::min() : std::numeric_limits<code>::max()))
+                return false;
+            code limit = x_left ? (while_true ? bound - 1 : bound) : (while_true ? bound + 1 : bound);
+            code distance;
+            if (upper != (step > 0) || __builtin_sub_overflow(upper ? limit : value, upper ? value : limit, &distance))
+                return false;
+            iterations = distance / (upper ? step : -step) + 1;
+        }
+
+        code final_value;
+        if (__builtin_mul_overflow(iterations, step, &final_value) || __builtin_add_overflow(value, final_value, &final_value))
+            return false;
+        if (trace)
+            std::cerr << std::format("loop [{}, {}] fast-forwarded {} iterations", target, jump_pc, iterations) << std::endl;
+        p.write(x, final_value);
+        if (has_cmp) {
+            auto l = x_left ? final_value : bound;
+            auto r = x_left ? bound : final_value;
+            p.write(t, cmp.opcode == Opcode::less_than ? (l < r ? 1 : 0) : (l == r ? 1 : 0));
+        }
+        pc = loop_end;
+        return true;
+    }
+
   public:
-    Computer(Program p) : p(p) {};
+    Computer(Program p, bool accelerate = false, bool trace = false) : p(p), accelerate(accelerate), trace(trace) {};
 
     /**
      * Takes an input and executes until another input is expected or the program
@@ -111,12 +396,14 @@ class Computer {
         std::deque<code> output{};
 
         while (true) {
-            std::cerr << std::left << std::setw(36) << std::format("executing opcode memory[{}]={}", pc, p.read(pc)) << " | ";
+            if (trace)
+                std::cerr << std::left << std::setw(36) << std::format("executing opcode memory[{}]={}", pc, p.read(pc)) << " | ";
             auto in = Instruction::parse(p.read(pc));
 
             switch (in.opcode) {
                 case Opcode::halt: {
-                    std::cerr << "halt" << std::endl;
+                    if (trace)
+                        std::cerr << "halt" << std::endl;
                     halted = true;
                     return {output, true};
                 }
@@ -124,7 +411,8 @@ class Computer {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
                     auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
                     auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
-                    std::cerr << std::format("*{} = {} + {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} + {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 + arg2);
                     pc += 4;
                     break;
@@ -133,19 +421,22 @@ class Computer {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
                     auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
                     auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
-                    std::cerr << std::format("*{} = {} * {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} * {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 * arg2);
                     pc += 4;
                     break;
                 }
                 case Opcode::input: {
                     if (input.empty()) {
-                        std::cerr << "break" << std::endl;
+                        if (trace)
+                            std::cerr << "break" << std::endl;
                         return {output, false};
                     }
                     auto arg1 = eval_write_operand(p.read(pc + 1), in.mode1);
                     auto arg2 = input.front();
-                    std::cerr << std::format("*{} = {}", arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {}", arg1, arg2) << std::endl;
                     p.write(arg1, arg2);
                     pc += 2;
                     input.pop_front();
@@ -153,7 +444,8 @@ class Computer {
                 }
                 case Opcode::output: {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
-                    std::cerr << std::format("print({})", arg1) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("print({})", arg1) << std::endl;
                     output.push_back(arg1);
                     pc += 2;
                     break;
@@ -161,14 +453,20 @@ class Computer {
                 case Opcode::jump_true: {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
                     auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
-                    std::cerr << std::format("pc = {} ? {} : pc+3", arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("pc = {} ? {} : pc+3", arg1, arg2) << std::endl;
+                    if (accelerate && arg1 != 0 && arg2 < pc && fast_forward_loop(arg2, pc))
+                        break;
                     pc = arg1 != 0 ? arg2 : pc + 3;
                     break;
                 }
                 case Opcode::jump_false: {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
                     auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
-                    std::cerr << std::format("pc = !{} ? {} : pc+3", arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("pc = !{} ? {} : pc+3", arg1, arg2) << std::endl;
+                    if (accelerate && arg1 == 0 && arg2 < pc && fast_forward_loop(arg2, pc))
+                        break;
                     pc = arg1 == 0 ? arg2 : pc + 3;
                     break;
                 }
@@ -176,7 +474,8 @@ class Computer {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
                     auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
                     auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
-                    std::cerr << std::format("*{} = {} < {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} < {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 < arg2 ? 1 : 0);
                     pc += 4;
                     break;
@@ -185,14 +484,16 @@ class Computer {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
                     auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
                     auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
-                    std::cerr << std::format("*{} = {} == {}", arg3, arg1, arg2) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("*{} = {} == {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 == arg2 ? 1 : 0);
                     pc += 4;
                     break;
                 }
                 case Opcode::relative_base: {
                     auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
-                    std::cerr << std::format("rb += {}", arg1) << std::endl;
+                    if (trace)
+                        std::cerr << std::format("rb += {}", arg1) << std::endl;
                     relative_base += arg1;
                     pc += 2;
                     break;
@@ -205,15 +506,15 @@ class Computer {
     }
 };
 
-void part1(Program program) {
-    auto computer = Computer(program);
+void part1(Program program, bool accelerate, bool trace) {
+    auto computer = Computer(program, accelerate, trace);
     std::deque<code> input{1};
     auto [output, halted] = computer.run(input);
     std::cout << std::format("Part 1: {}\n", output[0]);
 };
 
-void part2(Program program) {
-    auto computer = Computer(program);
+void part2(Program program, bool accelerate, bool trace) {
+    auto computer = Computer(program, accelerate, trace);
     std::deque<code> input{2};
     auto [output, halted] = computer.run(input);
     std::cout << std::format("Part 1: {}\n", output[0]);
@@ -224,14 +525,34 @@ void part2(Program program) {
 const std::string TEST_INPUT = "109,1,204,-1,1001,100,1,100,1008,100,16,101,1006,101,0,99";
 // clang-format on
 
-int main() {
+/**
+ * Usage: day09 [--accelerate] [--trace]
+ *
+ * --accelerate fast-forwards simple counting loops instead of stepping them.
+ * --trace prints every instruction executed, and every loop fast-forwarded, to
+ * stderr.
+ */
+int main(int argc, char **argv) {
+    bool accelerate = false;
+    bool trace = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--accelerate") {
+            accelerate = true;
+        } else if (arg == "--trace") {
+            trace = true;
+        } else {
+            std::cerr << std::format("unknown argument {}", arg) << std::endl;
+            return 2;
+        }
+    }
     std::ifstream real_input("inputs/day09.txt");
     std::istringstream test_input{TEST_INPUT};
     auto input = &real_input;
 
     Program program = Program::parse(*input);
-    part1(program);
-    part2(program);
+    part1(program, accelerate, trace);
+    part2(program, accelerate, trace);
 
     return 0;
 }
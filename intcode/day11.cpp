@@ -1,16 +1,23 @@
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <deque>
 #include <format>
 #include <fstream>
-#include <iomanip>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <optional>
 #include <ranges>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 enum class Opcode {
@@ -71,12 +78,204 @@ class Instruction {
 
 enum class RWMode { read, write };
 
+enum class TraceEvent : uint8_t { input = 0, output = 1, pc = 2, halt = 3 };
+
+/**
+ * Binary execution trace. Every event is a single LEB128 varint holding the
+ * event kind in the low two bits and the zigzag-encoded delta from the previous
+ * value of the same kind above them, so slowly changing streams (pc samples,
+ * camera colours) cost one byte per event.
+ */
+const std::string_view TRACE_MAGIC = "ICTRACE1";
+
+class TraceWriter {
+  private:
+    struct Record {
+        TraceEvent kind;
+        code value;
+    };
+    static constexpr std::size_t RING_SIZE = 1 << 16;
+
+    // Single-producer single-consumer ring: the VM pushes, the writer thread
+    // drains and encodes, so the hot loop never touches the file. At 1 MiB it
+    // is too big for the stack frames writers live in.
+    std::unique_ptr<Record[]> ring = std::make_unique_for_overwrite<Record[]>(RING_SIZE);
+    alignas(64) std::atomic<std::size_t> head = 0;
+    alignas(64) std::atomic<std::size_t> tail = 0;
+    // The writer thread sleeps on `wakeups` once the ring is empty, after
+    // setting `sleeping`; a push that sees the flag, a full ring and closing
+    // all bump it. The push reads the flag relaxed, so it can miss that the
+    // thread just went to sleep, which only delays the events until the next
+    // push or closing wakes it.
+    alignas(64) std::atomic<uint32_t> wakeups = 0;
+    std::atomic<bool> sleeping = false;
+    std::atomic<bool> closed = false;
+    std::ofstream file;
+    std::ostream &out;
+    std::thread writer;
+
+    void start() {
+        out.write(TRACE_MAGIC.data(), TRACE_MAGIC.size());
+        out.write(reinterpret_cast<const char *>(&pc_interval), sizeof(pc_interval));
+        writer = std::thread([this] { drain(); });
+    }
+    void wake() {
+        sleeping.store(false, std::memory_order_relaxed);
+        wakeups.fetch_add(1, std::memory_order_release);
+        wakeups.notify_one();
+    }
+
+    void drain() {
+        std::array<code, 4> last{};
+        std::vector<char> buffer;
+        buffer.reserve(1 << 16);
+        while (true) {
+            auto t = tail.load(std::memory_order_relaxed);
+            auto h = head.load(std::memory_order_acquire);
+            if (t == h) {
+                if (closed.load(std::memory_order_acquire) && tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire))
+                    break;
+                if (!buffer.empty()) {
+                    out.write(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+                // Read before the ring is checked again, so that a bump in
+                // between makes the wait return at once.
+                auto seen = wakeups.load(std::memory_order_acquire);
+                sleeping.store(true, std::memory_order_relaxed);
+                if (head.load(std::memory_order_acquire) == t && !closed.load(std::memory_order_acquire))
+                    wakeups.wait(seen, std::memory_order_acquire);
+                sleeping.store(false, std::memory_order_relaxed);
+                continue;
+            }
+            for (; t != h; t++) {
+                auto record = ring[t % RING_SIZE];
+                auto kind = static_cast<std::size_t>(record.kind);
+                auto delta = static_cast<uint64_t>(record.value) - static_cast<uint64_t>(last[kind]);
+                last[kind] = record.value;
+                auto zigzag = (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+                auto word = (static_cast<unsigned __int128>(zigzag) << 2) | kind;
+                do {
+                    uint8_t byte = word & 0x7f;
+                    word >>= 7;
+                    buffer.push_back(static_cast<char>(word ? byte | 0x80 : byte));
+                } while (word);
+            }
+            tail.store(t, std::memory_order_release);
+            tail.notify_one();
+            if (buffer.size() >= (1 << 16) - 16) {
+                out.write(buffer.data(), buffer.size());
+                buffer.clear();
+            }
+        }
+        out.write(buffer.data(), buffer.size());
+        out.flush();
+    }
+
+  public:
+    // Sample the pc every this many instructions; 0 disables pc sampling.
+    const uint32_t pc_interval;
+
+    TraceWriter(const std::string &path, uint32_t pc_interval) : file(path, std::ios::binary), out(file), pc_interval(pc_interval) {
+        if (!file)
+            throw std::runtime_error(std::format("cannot open trace file {}", path));
+        start();
+    }
+    /**
+     * Writes the trace to `out`, which must outlive the writer.
+     */
+    TraceWriter(std::ostream &out, uint32_t pc_interval) : out(out), pc_interval(pc_interval) {
+        start();
+    }
+    ~TraceWriter() {
+        closed.store(true, std::memory_order_release);
+        wake();
+        writer.join();
+    }
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    void push(TraceEvent kind, code value) {
+        auto h = head.load(std::memory_order_relaxed);
+        for (std::size_t t; h - (t = tail.load(std::memory_order_acquire)) == RING_SIZE;) {
+            wake();
+            tail.wait(t, std::memory_order_acquire);
+        }
+        ring[h % RING_SIZE] = {kind, value};
+        head.store(h + 1, std::memory_order_release);
+        if (sleeping.load(std::memory_order_relaxed)) [[unlikely]]
+            wake();
+    }
+};
+
+class Trace {
+  public:
+    uint32_t pc_interval;
+    std::vector<std::tuple<TraceEvent, code>> events;
+
+    static Trace read(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        return read(file, path);
+    }
+    /**
+     * Reads a trace from `file`; `name` only appears in errors.
+     */
+    static Trace read(std::istream &file, const std::string &name) {
+        std::string magic(TRACE_MAGIC.size(), '\0');
+        file.read(magic.data(), magic.size());
+        if (!file || magic != TRACE_MAGIC)
+            throw std::runtime_error(std::format("{} is not an intcode trace", name));
+        Trace trace{};
+        file.read(reinterpret_cast<char *>(&trace.pc_interval), sizeof(trace.pc_interval));
+
+        std::array<code, 4> last{};
+        unsigned __int128 word = 0;
+        int shift = 0;
+        for (int c; (c = file.get()) != EOF;) {
+            word |= static_cast<unsigned __int128>(c & 0x7f) << shift;
+            shift += 7;
+            if (c & 0x80)
+                continue;
+            auto kind = static_cast<std::size_t>(word & 3);
+            auto zigzag = static_cast<uint64_t>(word >> 2);
+            auto delta = (zigzag >> 1) ^ -(zigzag & 1);
+            last[kind] = static_cast<code>(static_cast<uint64_t>(last[kind]) + delta);
+            trace.events.push_back({static_cast<TraceEvent>(kind), last[kind]});
+            word = 0;
+            shift = 0;
+        }
+        return trace;
+    }
+};
+
+/**
+ * An environment that takes inputs from one queue and collects outputs in
+ * another, for drivers that run the computer in rounds.
+ */
+struct QueueEnv {
+    std::deque<code> &inputs;
+    std::deque<code> outputs{};
+
+    std::optional<code> input() {
+        if (inputs.empty())
+            return std::nullopt;
+        auto x = inputs.front();
+        inputs.pop_front();
+        return x;
+    }
+    void output(code x) {
+        outputs.push_back(x);
+    }
+};
+
 class Computer {
   private:
     Program p;
     code pc = 0;
     code relative_base = 0;
     bool halted = false;
+    TraceWriter *trace = nullptr;
+    uint32_t until_sample = 0;
     code eval_operand(code parameter, ParamMode mode, RWMode rw) {
         if (mode == ParamMode::immediate) {
             assert(rw == RWMode::read);
@@ -98,30 +297,55 @@ class Computer {
   public:
     Computer(Program p) : p(p) {};
 
+    /**
+     * Streams inputs, outputs and (optionally) sampled pcs of every subsequent
+     * run to the trace. The writer must outlive the computer's runs.
+     */
+    void record(TraceWriter *writer) {
+        trace = writer;
+        until_sample = writer ? writer->pc_interval : 0;
+    }
+
     /**
      * Takes an input and executes until another input is expected or the program
      * halts. Returns a tuple containing the output so far and whethr the computer
      * halted.
      */
     std::tuple<std::deque<code>, bool> run(std::deque<code> &input) {
+        QueueEnv env{input};
+        auto halted = run(env);
+        return {std::move(env.outputs), halted};
+    }
+
+    /**
+     * Executes until the program halts or `env` has no input for it. Input
+     * instructions call `env.input()`, which returns nullopt to suspend, and
+     * output instructions call `env.output(value)`. The environment is a
+     * template parameter, so both calls are inlined into the loop and a
+     * driver written this way costs no more per step than the instructions
+     * it runs. Returns whether the computer halted.
+     */
+    template <typename Env> bool run(Env &env) {
         assert(!halted);
-        std::deque<code> output{};
 
         while (true) {
-            std::cerr << std::left << std::setw(36) << std::format("executing opcode memory[{}]={}", pc, p.read(pc)) << " | ";
+            if (until_sample && --until_sample == 0) {
+                trace->push(TraceEvent::pc, pc);
+                until_sample = trace->pc_interval;
+            }
             auto in = Instruction::parse(p.read(pc));
 
             switch (in.opcode) {
                 case Opcode::halt: {
-                    std::cerr << "halt" << std::endl;
+                    if (trace)
+                        trace->push(TraceEvent::halt, pc);
                     halted = true;
-                    return {output, true};
+                    return true;
                 }
                 case Opcode::add: {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
                     auto arg2 = eval_operand(p.read(pc + 2), in.mode2, RWMode::read);
                     auto arg3 = eval_operand(p.read(pc + 3), in.mode3, RWMode::write);
-                    std::cerr << std::format("*{} = {} + {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 + arg2);
                     pc += 4;
                     break;
@@ -130,42 +354,43 @@ class Computer {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
                     auto arg2 = eval_operand(p.read(pc + 2), in.mode2, RWMode::read);
                     auto arg3 = eval_operand(p.read(pc + 3), in.mode3, RWMode::write);
-                    std::cerr << std::format("*{} = {} * {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 * arg2);
                     pc += 4;
                     break;
                 }
                 case Opcode::input: {
-                    if (input.empty()) {
-                        std::cerr << "break" << std::endl;
-                        return {output, false};
+                    auto arg2 = env.input();
+                    if (!arg2) {
+                        // This instruction runs again on resuming; take back
+                        // its count so that it is not sampled twice.
+                        if (until_sample)
+                            until_sample++;
+                        return false;
                     }
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::write);
-                    auto arg2 = input.front();
-                    std::cerr << std::format("*{} = {}", arg1, arg2) << std::endl;
-                    p.write(arg1, arg2);
+                    if (trace)
+                        trace->push(TraceEvent::input, *arg2);
+                    p.write(arg1, *arg2);
                     pc += 2;
-                    input.pop_front();
                     break;
                 }
                 case Opcode::output: {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
-                    std::cerr << std::format("print({})", arg1) << std::endl;
-                    output.push_back(arg1);
+                    if (trace)
+                        trace->push(TraceEvent::output, arg1);
+                    env.output(arg1);
                     pc += 2;
                     break;
                 }
                 case Opcode::jump_true: {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
                     auto arg2 = eval_operand(p.read(pc + 2), in.mode2, RWMode::read);
-                    std::cerr << std::format("pc = {} ? {} : pc+3", arg1, arg2) << std::endl;
                     pc = arg1 != 0 ? arg2 : pc + 3;
                     break;
                 }
                 case Opcode::jump_false: {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
                     auto arg2 = eval_operand(p.read(pc + 2), in.mode2, RWMode::read);
-                    std::cerr << std::format("pc = !{} ? {} : pc+3", arg1, arg2) << std::endl;
                     pc = arg1 == 0 ? arg2 : pc + 3;
                     break;
                 }
@@ -173,7 +398,6 @@ class Computer {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
                     auto arg2 = eval_operand(p.read(pc + 2), in.mode2, RWMode::read);
                     auto arg3 = eval_operand(p.read(pc + 3), in.mode3, RWMode::write);
-                    std::cerr << std::format("*{} = {} < {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 < arg2 ? 1 : 0);
                     pc += 4;
                     break;
@@ -182,14 +406,12 @@ class Computer {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
                     auto arg2 = eval_operand(p.read(pc + 2), in.mode2, RWMode::read);
                     auto arg3 = eval_operand(p.read(pc + 3), in.mode3, RWMode::write);
-                    std::cerr << std::format("*{} = {} == {}", arg3, arg1, arg2) << std::endl;
                     p.write(arg3, arg1 == arg2 ? 1 : 0);
                     pc += 4;
                     break;
                 }
                 case Opcode::relative_base: {
                     auto arg1 = eval_operand(p.read(pc + 1), in.mode1, RWMode::read);
-                    std::cerr << std::format("rb += {}", arg1) << std::endl;
                     relative_base += arg1;
                     pc += 2;
                     break;
@@ -204,45 +426,140 @@ class Computer {
 
 enum class Direction { up = 0, right = 1, down = 2, left = 3 };
 
-typedef std::map<std::tuple<int, int>, int> map;
+// Panel colors keyed by position, packed as (x << 32) | y so that a lookup
+// hashes one word.
+typedef std::unordered_map<uint64_t, int> map;
 
-map run_robot(Computer computer, map map) {
-    std::deque<code> input = {};
-
-    int rx = 0;
-    int ry = 0;
-    Direction rd = Direction::up;
-
-    while (true) {
-        assert(input.size() == 0);
-        input.push_back(map[{rx, ry}]);
-        auto [output, halted] = computer.run(input);
-        assert(output.size() == 2);
-        map[{rx, ry}] = output[0];
-        rd = static_cast<Direction>((static_cast<int>(rd) + (output[1] ? 1 : 3)) % 4);
-        rx = rx + (rd == Direction::right ? 1 : rd == Direction::left ? -1 : 0);
-        ry = ry + (rd == Direction::up ? 1 : rd == Direction::down ? -1 : 0);
-        if (halted) {
-            break;
+uint64_t panel(int x, int y) {
+    return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(y);
+}
+
+/**
+ * The painting robot as an environment: each input is the camera reading the
+ * color under the robot, and outputs alternate between the color to paint
+ * there and the way to turn before moving. The camera read finds the panel and
+ * the paint reuses it, so there is a single hull lookup per step.
+ */
+class Robot {
+  private:
+    int x = 0;
+    int y = 0;
+    Direction d = Direction::up;
+    int *under = nullptr;
+    bool painting = true;
+
+  public:
+    map hull;
+    Robot(map hull) : hull(std::move(hull)) {};
+
+    std::optional<code> input() {
+        under = &hull[panel(x, y)];
+        return *under;
+    }
+    void output(code value) {
+        if (painting) {
+            if (!under)
+                under = &hull[panel(x, y)];
+            *under = value;
+        } else {
+            d = static_cast<Direction>((static_cast<int>(d) + (value ? 1 : 3)) % 4);
+            x += d == Direction::right ? 1 : d == Direction::left ? -1 : 0;
+            y += d == Direction::up ? 1 : d == Direction::down ? -1 : 0;
+            under = nullptr;
         }
+        painting = !painting;
     }
+};
 
-    return map;
+map run_robot(Computer computer, map map) {
+    Robot robot(std::move(map));
+    computer.run(robot);
+    return std::move(robot.hull);
 }
 
-void part1(Program program) {
+/**
+ * Re-executes a recorded run from its inputs alone and checks that the program
+ * produces the same outputs, without the robot or any other live environment.
+ * The replay is itself traced in memory at the recorded pc interval, so its pc
+ * samples have to match the recorded ones too.
+ */
+void replay(Program program, const std::string &path) {
+    auto trace = Trace::read(path);
+    std::deque<code> inputs{};
+    std::deque<code> expected{};
+    std::vector<code> expected_pcs{};
+    bool expect_halt = false;
+    for (auto [kind, value] : trace.events) {
+        if (kind == TraceEvent::input)
+            inputs.push_back(value);
+        else if (kind == TraceEvent::output)
+            expected.push_back(value);
+        else if (kind == TraceEvent::pc)
+            expected_pcs.push_back(value);
+        else if (kind == TraceEvent::halt)
+            expect_halt = true;
+    }
+    auto n_inputs = inputs.size();
+    auto n_outputs = expected.size();
+
     auto computer = Computer(program);
+    std::deque<code> input{};
+    std::size_t seen = 0;
+    bool halted = false;
+    std::stringstream replayed{};
+    {
+        TraceWriter writer(replayed, trace.pc_interval);
+        computer.record(&writer);
+        while (!halted) {
+            auto [output, h] = computer.run(input);
+            halted = h;
+            for (auto x : output) {
+                if (expected.empty() || expected.front() != x)
+                    throw std::runtime_error(std::format("replay diverged at output {}: got {}", seen, x));
+                expected.pop_front();
+                seen++;
+            }
+            if (halted)
+                break;
+            if (inputs.empty()) {
+                if (expect_halt)
+                    throw std::runtime_error("replay diverged: program wants more inputs than were recorded");
+                break;
+            }
+            input.push_back(inputs.front());
+            inputs.pop_front();
+        }
+        computer.record(nullptr);
+    }
+    if (!expected.empty() || (expect_halt && !halted))
+        throw std::runtime_error(std::format("replay diverged: {} recorded outputs were not produced", expected.size()));
+    std::size_t sample = 0;
+    for (auto [kind, value] : Trace::read(replayed, "the replay").events) {
+        if (kind != TraceEvent::pc)
+            continue;
+        if (sample == expected_pcs.size() || expected_pcs[sample] != value)
+            throw std::runtime_error(std::format("replay diverged at pc sample {}: got {}", sample, value));
+        sample++;
+    }
+    if (sample != expected_pcs.size())
+        throw std::runtime_error(std::format("replay diverged: {} recorded pc samples were not taken", expected_pcs.size() - sample));
+    std::cout << std::format("Replay: {} inputs, {} outputs, {} pc samples, {}\n", n_inputs, n_outputs, expected_pcs.size(), halted ? "halted" : "suspended");
+}
+
+void part1(Program program, TraceWriter *trace) {
+    auto computer = Computer(program);
+    computer.record(trace);
     auto map = run_robot(computer, {});
     std::cout << std::format("Part 1: {}\n", map.size());
 };
 
-void part2(Program program) {
+void part2(Program program, TraceWriter *trace) {
     auto computer = Computer(program);
-    auto map = run_robot(computer, {{{0, 0}, 1}});
-
+    computer.record(trace);
+    auto map = run_robot(computer, {{panel(0, 0), 1}});
     int min_x = 9999, min_y = 9999, max_x = -9999, max_y = -9999;
-    for (auto const &[coord, _] : map) {
-        auto [x, y] = coord;
+    for (auto const &[key, _] : map) {
+        int x = static_cast<int32_t>(key >> 32), y = static_cast<int32_t>(key);
         min_x = std::min(min_x, x);
         min_y = std::min(min_y, y);
         max_x = std::max(max_x, x);
@@ -252,20 +569,56 @@ void part2(Program program) {
     std::cout << "Part 2:" << std::endl;
     for (int y = max_y; y >= min_y; y--) {
         for (int x = min_x; x <= max_x; x++) {
-            auto it = map.find({x, y});
+            auto it = map.find(panel(x, y));
             std::cout << (it != map.end() && it->second ? "#" : " ");
         }
         std::cout << std::endl;
     }
 };
 
-int main() {
+/**
+ * Usage: day11 [--record PREFIX [--sample-pc N]] [--replay TRACE]
+ *
+ * --record writes PREFIX.part1.trace and PREFIX.part2.trace; --replay re-runs
+ * one of them without the robot.
+ */
+int main(int argc, char **argv) {
     std::ifstream real_input("inputs/day11.txt");
     auto input = &real_input;
 
+    std::string record_prefix{};
+    std::string replay_path{};
+    uint32_t pc_interval = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) {
+            record_prefix = argv[++i];
+        } else if (arg == "--sample-pc" && i + 1 < argc) {
+            pc_interval = std::stoul(argv[++i]);
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else {
+            std::cerr << std::format("unknown argument {}", arg) << std::endl;
+            return 1;
+        }
+    }
+
     Program program = Program::parse(*input);
-    part1(program);
-    part2(program);
+    if (!replay_path.empty()) {
+        replay(program, replay_path);
+        return 0;
+    }
+    if (record_prefix.empty()) {
+        part1(program, nullptr);
+        part2(program, nullptr);
+    } else {
+        {
+            TraceWriter trace(record_prefix + ".part1.trace", pc_interval);
+            part1(program, &trace);
+        }
+        TraceWriter trace(record_prefix + ".part2.trace", pc_interval);
+        part2(program, &trace);
+    }
 
     return 0;
 }
@@ -0,0 +1,695 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+enum class Opcode {
+    add = 1,
+    mul = 2,
+    input = 3,
+    output = 4,
+    jump_true = 5,
+    jump_false = 6,
+    less_than = 7,
+    equals = 8,
+    relative_base = 9,
+    halt = 99,
+};
+
+enum class ParamMode {
+    position = 0,
+    immediate = 1,
+    relative = 2,
+};
+
+typedef long code;
+
+class Program {
+  private:
+    std::vector<code> memory;
+
+  public:
+    static Program parse(std::istream &input_stream) {
+        std::vector<code> program{};
+        for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
+            auto opcode = std::stol(opcode_s);
+            program.push_back(opcode);
+        }
+        return Program(program);
+    }
+    Program(std::vector<code> memory) : memory(std::move(memory)) {};
+
+    code read(code index) const {
+        if (index < 0)
+            throw std::out_of_range(std::format("memory fault at address {}", index));
+        return static_cast<std::size_t>(index) < memory.size() ? memory[index] : 0;
+    }
+    void write(code index, code value) {
+        if (index < 0)
+            throw std::out_of_range(std::format("memory fault at address {}", index));
+        if (static_cast<std::size_t>(index) >= memory.size())
+            memory.resize(index + 1);
+        memory[index] = value;
+    }
+
+    /**
+     * Hashes the contents, ignoring trailing zeroes: memory grown by a write
+     * of zero reads the same as memory that was never grown.
+     */
+    uint64_t hash() const {
+        auto end = memory.size();
+        while (end > 0 && memory[end - 1] == 0)
+            end--;
+        uint64_t h = end;
+        for (std::size_t i = 0; i < end; i++)
+            h = mix(h, static_cast<uint64_t>(memory[i]));
+        return h;
+    }
+    static uint64_t mix(uint64_t h, uint64_t x) {
+        h ^= x + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+        return h * 0xff51afd7ed558ccd;
+    }
+};
+
+class Instruction {
+  public:
+    Opcode opcode;
+    ParamMode mode1;
+    ParamMode mode2;
+    ParamMode mode3;
+    static Instruction parse(code x) {
+        return Instruction(Opcode(x % 100), ParamMode((x / 100) % 10), ParamMode((x / 1000) % 10), ParamMode((x / 10000) % 10));
+    };
+};
+
+enum class Stop { halted, needs_input, preempted };
+
+class Computer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+    code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return p.read(parameter);
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return p.read(relative_base + parameter);
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return parameter;
+            case ParamMode::relative:
+                return relative_base + parameter;
+            case ParamMode::immediate:
+                throw std::invalid_argument("write operands cannot be in immediate mode");
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+
+  public:
+    Computer(Program p) : p(std::move(p)) {};
+
+    bool is_halted() const {
+        return halted;
+    }
+    uint64_t hash() const {
+        return Program::mix(Program::mix(Program::mix(p.hash(), pc), relative_base), halted);
+    }
+
+    /**
+     * Executes until the program halts, needs an input that `input` cannot
+     * supply, or has taken `budget` instructions.
+     */
+    Stop run(std::deque<code> &input, std::vector<code> &output, uint64_t budget) {
+        assert(!halted);
+
+        for (uint64_t steps = 0; steps < budget; steps++) {
+            auto in = Instruction::parse(p.read(pc));
+
+            switch (in.opcode) {
+                case Opcode::halt: {
+                    halted = true;
+                    return Stop::halted;
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 + arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 * arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty())
+                        return Stop::needs_input;
+                    auto arg1 = eval_write_operand(p.read(pc + 1), in.mode1);
+                    p.write(arg1, input.front());
+                    pc += 2;
+                    input.pop_front();
+                    break;
+                }
+                case Opcode::output: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    output.push_back(arg1);
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 != 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 == 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 < arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 == arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    relative_base += arg1;
+                    pc += 2;
+                    break;
+                }
+                default: {
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.read(pc)));
+                }
+            }
+        }
+        return Stop::preempted;
+    }
+};
+
+/**
+ * How far a machine got: it wants the next value from the domain, it is
+ * finished, or it is dropped for running out of its instruction budget or
+ * failing (a memory fault or an invalid instruction).
+ */
+enum class Status { needs_input, finished, timeout, failed };
+
+/**
+ * One program fed by the explorer directly: every input instruction takes a
+ * value from the domain.
+ */
+class Single {
+  private:
+    Computer computer;
+    std::deque<code> input{};
+
+  public:
+    Single(const Program &program) : computer(program) {};
+
+    Status advance(std::vector<code> &output, uint64_t budget) {
+        switch (computer.run(input, output, budget)) {
+            case Stop::needs_input:
+                return Status::needs_input;
+            case Stop::halted:
+                return Status::finished;
+            default:
+                return Status::timeout;
+        }
+    }
+    void give(code value) {
+        input.push_back(value);
+    }
+    uint64_t hash() const {
+        return computer.hash();
+    }
+};
+
+/**
+ * Copies of one program wired in series as in day07: each amp's first input
+ * (its phase) comes from the domain, amp 0's second is a 0 signal, and every
+ * other input is the previous amp's output, the last one's feeding back into
+ * amp 0 with `loop`. An amp runs as soon as it has its phase, so searches
+ * that agree on the first phases share the work of the first amps. The
+ * outputs seen by the explorer are the last amp's.
+ */
+class Amplifiers {
+  private:
+    std::vector<Computer> amps;
+    std::vector<std::deque<code>> queues;
+    bool loop;
+    std::size_t phased = 0;
+
+  public:
+    Amplifiers(const Program &program, std::size_t count, bool loop) : amps(count, Computer(program)), queues(count), loop(loop) {};
+
+    Status advance(std::vector<code> &output, uint64_t budget) {
+        std::vector<code> produced{};
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            for (std::size_t i = 0; i < phased; i++) {
+                if (amps[i].is_halted())
+                    continue;
+                auto before = queues[i].size();
+                produced.clear();
+                auto stop = amps[i].run(queues[i], produced, budget);
+                if (stop == Stop::preempted)
+                    return Status::timeout;
+                auto last = i + 1 == amps.size();
+                if (last)
+                    output.insert(output.end(), produced.begin(), produced.end());
+                if (!last || loop)
+                    queues[last ? 0 : i + 1].insert(queues[last ? 0 : i + 1].end(), produced.begin(), produced.end());
+                progress |= !produced.empty() || queues[i].size() != before || stop == Stop::halted;
+            }
+        }
+        if (phased < amps.size())
+            return Status::needs_input;
+        return Status::finished;
+    }
+    void give(code value) {
+        queues[phased].push_front(value);
+        if (phased == 0)
+            queues[0].push_back(0);
+        phased++;
+    }
+    uint64_t hash() const {
+        uint64_t h = phased;
+        for (std::size_t i = 0; i < amps.size(); i++) {
+            h = Program::mix(h, amps[i].hash());
+            h = Program::mix(h, queues[i].size());
+            for (auto x : queues[i])
+                h = Program::mix(h, static_cast<uint64_t>(x));
+        }
+        return h;
+    }
+};
+
+struct Options {
+    std::vector<code> domain{};
+    // Longest input sequence to try.
+    std::size_t depth = 8;
+    // Use each domain value at most once per sequence (at most 64 values).
+    bool distinct = false;
+    // Instructions a branch may execute between two inputs before it is
+    // dropped as a timeout.
+    uint64_t budget = 10000000;
+    unsigned threads = 1;
+};
+
+struct Result {
+    std::optional<std::vector<code>> inputs{};
+    std::optional<code> score{};
+    uint64_t states = 0;
+    uint64_t duplicates = 0;
+    uint64_t timeouts = 0;
+    uint64_t failures = 0;
+};
+
+/**
+ * Searches every sequence of domain values a Machine can be fed, as a tree:
+ * each node is a machine stopped at an input, and its children are copies
+ * given one value each and run to their next input. Siblings thus share the
+ * execution of their common prefix, and a child whose state (by hash, with
+ * the last output and, with `distinct`, the values still unused) was already
+ * reached by a sequence no longer than its own is pruned, since everything
+ * below it was or will be explored there.
+ *
+ * Nodes go on one shared stack that `threads` workers pop. A worker keeps
+ * the first child of the node it expanded for itself and pushes the others,
+ * so it goes depth first while idle workers pick up the siblings.
+ */
+template <typename Machine> class Explorer {
+  private:
+    struct Node {
+        Machine machine;
+        std::vector<code> inputs;
+        std::optional<code> last;
+        uint64_t used;
+    };
+    struct Shard {
+        std::mutex mutex{};
+        std::unordered_map<uint64_t, std::size_t> depths{};
+    };
+
+    const Options &options;
+    std::function<bool(code)> predicate{};
+    std::mutex mutex{};
+    std::condition_variable ready{};
+    std::vector<Node> pending{};
+    std::size_t active = 0;
+    std::atomic<bool> stopped = false;
+    std::array<Shard, 64> seen{};
+    std::atomic<uint64_t> states = 0;
+    std::atomic<uint64_t> duplicates = 0;
+    std::atomic<uint64_t> timeouts = 0;
+    std::atomic<uint64_t> failures = 0;
+    std::mutex best_mutex{};
+    Result best{};
+
+    /**
+     * Records the shortest sequence that reached `node`'s state, and whether
+     * `node` is it.
+     */
+    bool first_visit(const Node &node) {
+        auto key = Program::mix(node.machine.hash(), node.last.has_value());
+        key = Program::mix(key, static_cast<uint64_t>(node.last.value_or(0)));
+        if (options.distinct)
+            key = Program::mix(key, node.used);
+        auto &shard = seen[key >> 58];
+        std::lock_guard lock(shard.mutex);
+        auto [it, inserted] = shard.depths.try_emplace(key, node.inputs.size());
+        if (inserted)
+            return true;
+        if (node.inputs.size() < it->second) {
+            it->second = node.inputs.size();
+            return true;
+        }
+        return false;
+    }
+
+    void offer(const Node &node) {
+        if (!node.last)
+            return;
+        std::lock_guard lock(best_mutex);
+        if (!best.score || *node.last > *best.score || (*node.last == *best.score && node.inputs < *best.inputs)) {
+            best.score = node.last;
+            best.inputs = node.inputs;
+        }
+    }
+
+    void found(const Node &node, code value) {
+        std::lock_guard lock(mutex);
+        if (stopped)
+            return;
+        best.score = value;
+        best.inputs = node.inputs;
+        stopped = true;
+        ready.notify_all();
+    }
+
+    /**
+     * Runs `machine` to its next input. Some inputs make a program fault or
+     * run into garbage, which only ends that branch.
+     */
+    Status advance(Machine &machine, std::vector<code> &output) {
+        try {
+            return machine.advance(output, options.budget);
+        } catch (std::exception &) {
+            return Status::failed;
+        }
+    }
+
+    /**
+     * Handles a machine that was just run to its next input: scores it or
+     * stops the search, and tells whether it can take more inputs.
+     */
+    bool settle(Node &node, Status status, const std::vector<code> &output) {
+        states++;
+        if (status == Status::timeout || status == Status::failed) {
+            (status == Status::timeout ? timeouts : failures)++;
+            return false;
+        }
+        if (predicate) {
+            for (auto x : output) {
+                if (predicate(x)) {
+                    found(node, x);
+                    return false;
+                }
+            }
+        }
+        if (!output.empty())
+            node.last = output.back();
+        if (!predicate)
+            offer(node);
+        return status != Status::finished && node.inputs.size() < options.depth;
+    }
+
+    void expand(Node node) {
+        std::vector<code> output{};
+        std::vector<Node> children{};
+        while (!stopped) {
+            children.clear();
+            for (std::size_t k = 0; k < options.domain.size(); k++) {
+                auto bit = uint64_t{1} << k;
+                if (options.distinct && (node.used & bit) != 0)
+                    continue;
+                Node child{node.machine, node.inputs, node.last, node.used | bit};
+                child.inputs.push_back(options.domain[k]);
+                child.machine.give(options.domain[k]);
+                output.clear();
+                auto status = advance(child.machine, output);
+                if (!settle(child, status, output))
+                    continue;
+                if (!first_visit(child)) {
+                    duplicates++;
+                    continue;
+                }
+                children.push_back(std::move(child));
+            }
+            if (children.empty())
+                return;
+            if (children.size() > 1) {
+                std::lock_guard lock(mutex);
+                // Reversed, so the stack hands them out in domain order.
+                for (auto i = children.size() - 1; i > 0; i--)
+                    pending.push_back(std::move(children[i]));
+                ready.notify_all();
+            }
+            node = std::move(children.front());
+        }
+    }
+
+    void work() {
+        while (true) {
+            std::optional<Node> node{};
+            {
+                std::unique_lock lock(mutex);
+                ready.wait(lock, [&] { return stopped || !pending.empty() || active == 0; });
+                if (stopped || pending.empty())
+                    return;
+                node.emplace(std::move(pending.back()));
+                pending.pop_back();
+                active++;
+            }
+            expand(std::move(*node));
+            std::lock_guard lock(mutex);
+            active--;
+            if (active == 0 && pending.empty())
+                ready.notify_all();
+        }
+    }
+
+    Result search(Machine root) {
+        Node node{std::move(root), {}, {}, 0};
+        std::vector<code> output{};
+        auto status = advance(node.machine, output);
+        if (settle(node, status, output)) {
+            first_visit(node);
+            pending.push_back(std::move(node));
+            std::vector<std::jthread> workers{};
+            for (unsigned i = 0; i < std::max(1u, options.threads); i++)
+                workers.emplace_back([this] { work(); });
+        }
+        best.states = states;
+        best.duplicates = duplicates;
+        best.timeouts = timeouts;
+        best.failures = failures;
+        return best;
+    }
+
+  public:
+    Explorer(const Options &options) : options(options) {
+        if (options.distinct && options.domain.size() > 64)
+            throw std::invalid_argument("a distinct domain can have at most 64 values");
+    };
+
+    /**
+     * The sequence after which the machine's last output is largest, ties
+     * going to the lexicographically smallest (so the shortest of those that
+     * share a prefix).
+     */
+    Result maximize(Machine root) {
+        predicate = nullptr;
+        return search(std::move(root));
+    }
+
+    /**
+     * Some sequence under which the machine outputs a value for which
+     * `predicate` holds, and that value as the score. Which one is found
+     * first depends on the scheduling of the workers.
+     */
+    Result find(Machine root, std::function<bool(code)> predicate) {
+        this->predicate = std::move(predicate);
+        return search(std::move(root));
+    }
+};
+
+/**
+ * Parses a comma separated list of values or a range LO..HI.
+ */
+std::vector<code> parse_domain(const std::string &spec) {
+    std::vector<code> values{};
+    auto dots = spec.find("..");
+    if (dots != std::string::npos) {
+        auto lo = std::stol(spec.substr(0, dots));
+        auto hi = std::stol(spec.substr(dots + 2));
+        for (auto x = lo; x <= hi; x++)
+            values.push_back(x);
+        return values;
+    }
+    std::istringstream stream(spec);
+    for (std::string part; std::getline(stream, part, ',');)
+        values.push_back(std::stol(part));
+    return values;
+}
+
+template <typename Machine> int explore(const Options &options, Machine root, std::optional<code> target) {
+    auto start = std::chrono::steady_clock::now();
+    Explorer<Machine> explorer(options);
+    auto result = target ? explorer.find(std::move(root), [&](code x) { return x == *target; }) : explorer.maximize(std::move(root));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto counts = std::format("{} states, {} duplicates, {} timeouts, {} failures", result.states, result.duplicates, result.timeouts, result.failures);
+    std::cerr << std::format("{} in {:.3f}s", counts, elapsed.count()) << std::endl;
+    if (!result.inputs) {
+        std::cerr << "explore: no input sequence found" << std::endl;
+        return 1;
+    }
+    std::string inputs{};
+    for (auto x : *result.inputs)
+        inputs += std::format("{}{}", inputs.empty() ? "" : ",", x);
+    std::cout << std::format("{} {}", *result.score, inputs) << std::endl;
+    return 0;
+}
+
+/**
+ * Usage: explore --domain VALUES (--maximize | --find VALUE) [--depth N] [--distinct] [--amplifiers N [--loop]]
+ *                [--threads N] [--budget STEPS] PROGRAM
+ *
+ * Searches the input sequences PROGRAM can be given, every input taken from
+ * VALUES (a comma separated list, or LO..HI), for the one of at most N inputs
+ * (default 8) after which the last output is largest, or for one under which
+ * PROGRAM outputs VALUE. Prints the score and the sequence, e.g. "43210
+ * 4,3,2,1,0", and the search statistics to stderr.
+ *
+ * --distinct uses each value at most once. --amplifiers runs N copies of
+ * PROGRAM in series with their phases from the domain, as in day07, and
+ * --loop feeds the last back into the first; so day07's two parts are
+ *
+ *     explore --domain 0..4 --distinct --amplifiers 5 --maximize inputs/day07.txt
+ *     explore --domain 5..9 --distinct --amplifiers 5 --loop --maximize inputs/day07.txt
+ *
+ * The search runs on N threads (default: one per CPU). It drops a branch
+ * that faults, hits an invalid instruction or runs STEPS instructions
+ * (default 10000000) without needing an input.
+ */
+int main(int argc, char **argv) {
+    Options options{};
+    options.threads = std::max(1u, std::thread::hardware_concurrency());
+    std::optional<code> target{};
+    bool maximize = false;
+    std::size_t amplifiers = 0;
+    bool loop = false;
+    std::string path{};
+    auto usage = [] {
+        std::cerr << "usage: explore --domain VALUES (--maximize | --find VALUE) [--depth N] [--distinct] [--amplifiers N [--loop]]\n"
+                     "               [--threads N] [--budget STEPS] PROGRAM"
+                  << std::endl;
+        return 2;
+    };
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--domain" && i + 1 < argc) {
+                options.domain = parse_domain(argv[++i]);
+            } else if (arg == "--depth" && i + 1 < argc) {
+                options.depth = std::stoul(argv[++i]);
+            } else if (arg == "--threads" && i + 1 < argc) {
+                options.threads = std::max(1, std::stoi(argv[++i]));
+            } else if (arg == "--budget" && i + 1 < argc) {
+                options.budget = std::stoull(argv[++i]);
+            } else if (arg == "--amplifiers" && i + 1 < argc) {
+                amplifiers = std::stoul(argv[++i]);
+            } else if (arg == "--find" && i + 1 < argc) {
+                target = std::stol(argv[++i]);
+            } else if (arg == "--maximize") {
+                maximize = true;
+            } else if (arg == "--distinct") {
+                options.distinct = true;
+            } else if (arg == "--loop") {
+                loop = true;
+            } else if (!arg.starts_with("--") && path.empty()) {
+                path = arg;
+            } else {
+                std::cerr << std::format("unknown argument {}", arg) << std::endl;
+                return 2;
+            }
+        }
+    } catch (std::exception &) {
+        return usage();
+    }
+    if (path.empty() || options.domain.empty() || maximize == target.has_value() || (loop && amplifiers == 0))
+        return usage();
+
+    try {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << std::format("cannot open {}", path) << std::endl;
+            return 2;
+        }
+        auto program = Program::parse(file);
+        if (amplifiers > 0) {
+            options.depth = amplifiers;
+            return explore(options, Amplifiers(program, amplifiers, loop), target);
+        }
+        return explore(options, Single(program), target);
+    } catch (std::exception &e) {
+        std::cerr << std::format("explore: {}", e.what()) << std::endl;
+        return 1;
+    }
+}
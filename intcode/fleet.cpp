@@ -0,0 +1,973 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <optional>
+#include <poll.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+enum class Opcode {
+    add = 1,
+    mul = 2,
+    input = 3,
+    output = 4,
+    jump_true = 5,
+    jump_false = 6,
+    less_than = 7,
+    equals = 8,
+    relative_base = 9,
+    halt = 99,
+};
+
+enum class ParamMode {
+    position = 0,
+    immediate = 1,
+    relative = 2,
+};
+
+typedef long code;
+
+/**
+ * Raised when the program touches an address outside of its memory, i.e. not
+ * in [0, 2^31).
+ */
+class MemoryFault : public std::out_of_range {
+  public:
+    code address;
+    MemoryFault(code address) : std::out_of_range(std::format("memory fault at address {}", address)), address(address) {};
+};
+
+/**
+ * Memory is one anonymous mapping, zero-filled on demand by the kernel, that
+ * covers addresses [0, capacity). A write past it moves the mapping to a
+ * larger one with mremap, which carries the page tables over, so nothing is
+ * copied and untouched pages stay uncommitted. Reads and writes inside the
+ * mapping are plain loads and stores behind one unsigned compare, which also
+ * turns away negative addresses; reads past it are zeroes.
+ *
+ * This class is pasted verbatim into every tool that keeps Intcode memory in
+ * a mapping; keep the copies identical.
+ */
+class Program {
+  private:
+    // Smallest mapping, so that most programs never grow.
+    static constexpr std::size_t MIN_CAPACITY = std::size_t{1} << 16;
+    // Below this many bytes, clearing memory is cheaper than a madvise call.
+    static constexpr std::ptrdiff_t DISCARD_BYTES = 64 << 10;
+
+    code *memory = nullptr;
+    // Words mapped at `memory`, a power of two.
+    std::size_t capacity = 0;
+    // One past the highest address written, so copies know what to clone.
+    std::size_t extent = 0;
+
+    static std::size_t capacity_for(std::size_t words) {
+        return std::max(MIN_CAPACITY, std::bit_ceil(words));
+    }
+    [[gnu::cold]] code read_outside(code index) const {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        return 0;
+    }
+    [[gnu::cold]] void grow(code index) {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        reserve(index + 1);
+    }
+
+  public:
+    // Addresses are [0, WORDS).
+    static constexpr std::size_t WORDS = std::size_t{1} << 31;
+
+    /**
+     * A program of `extent` zero words.
+     */
+    explicit Program(std::size_t extent) : capacity(capacity_for(extent)), extent(extent) {
+        auto region = mmap(nullptr, capacity * sizeof(code), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping intcode memory");
+        memory = static_cast<code *>(region);
+    }
+    Program(const std::vector<code> &image) : Program(image.size()) {
+        std::memcpy(memory, image.data(), image.size() * sizeof(code));
+    }
+    static Program parse(std::istream &input_stream) {
+        std::vector<code> program{};
+        for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
+            auto opcode = std::stol(opcode_s);
+            program.push_back(opcode);
+        }
+        return Program(program);
+    }
+    Program(const Program &other) : Program(other.extent) {
+        std::memcpy(memory, other.memory, extent * sizeof(code));
+    }
+    Program(Program &&other) noexcept : memory(other.memory), capacity(other.capacity), extent(other.extent) {
+        other.memory = nullptr;
+    }
+    Program &operator=(Program other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(capacity, other.capacity);
+        std::swap(extent, other.extent);
+        return *this;
+    }
+    ~Program() {
+        if (memory)
+            munmap(memory, capacity * sizeof(code));
+    }
+
+    code read(code index) const {
+        if (static_cast<uint64_t>(index) < capacity) [[likely]]
+            return memory[index];
+        return read_outside(index);
+    }
+    void write(code index, code value) {
+        if (static_cast<uint64_t>(index) >= capacity) [[unlikely]]
+            grow(index);
+        memory[index] = value;
+        extent = std::max(extent, static_cast<std::size_t>(index) + 1);
+    }
+
+    std::size_t size() const {
+        return extent;
+    }
+    code *data() {
+        return memory;
+    }
+    const code *data() const {
+        return memory;
+    }
+
+    /**
+     * Maps at least `words` words. Growing may move the mapping, which
+     * invalidates pointers from data().
+     */
+    void reserve(std::size_t words) {
+        if (words <= capacity)
+            return;
+        auto bigger = capacity_for(words);
+        auto region = mremap(memory, capacity * sizeof(code), bigger * sizeof(code), MREMAP_MAYMOVE);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "growing intcode memory");
+        memory = static_cast<code *>(region);
+        capacity = bigger;
+    }
+
+    /**
+     * Makes this program's memory equal to `image` again without remapping:
+     * the image is copied back in and whatever was written past its end is
+     * cleared.
+     */
+    void reset(const Program &image) {
+        reserve(image.extent);
+        std::memcpy(memory, image.memory, image.extent * sizeof(code));
+        if (extent > image.extent)
+            clear(image.extent, extent);
+        extent = image.extent;
+    }
+
+    /**
+     * Zeroes words [from, to). Short ranges are overwritten; in longer ones
+     * the whole pages are handed back to the kernel, so the cost follows the
+     * pages actually touched rather than the range: a run that wrote one word
+     * at a high address leaves gigabytes below it that were never faulted in,
+     * and writing zeroes over them would commit them all.
+     */
+    void clear(std::size_t from, std::size_t to) {
+        static const auto page_bytes = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<char *>(memory + from);
+        auto end = reinterpret_cast<char *>(memory + to);
+        auto first = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(begin) + page_bytes - 1) & ~(page_bytes - 1));
+        auto last = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(end) & ~(page_bytes - 1));
+        if (last - first < DISCARD_BYTES) {
+            std::memset(begin, 0, end - begin);
+            return;
+        }
+        std::memset(begin, 0, first - begin);
+        std::memset(last, 0, end - last);
+        if (madvise(first, last - first, MADV_DONTNEED) != 0)
+            throw std::system_error(errno, std::generic_category(), "discarding intcode memory");
+    }
+};
+
+class Instruction {
+  public:
+    Opcode opcode;
+    ParamMode mode1;
+    ParamMode mode2;
+    ParamMode mode3;
+    static Instruction parse(code x) {
+        return Instruction(Opcode(x % 100), ParamMode((x / 100) % 10), ParamMode((x / 1000) % 10), ParamMode((x / 10000) % 10));
+    };
+};
+
+enum class Stop { halted, needs_input, output_full };
+
+class Computer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+    code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return p.read(parameter);
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return p.read(relative_base + parameter);
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return parameter;
+            case ParamMode::relative:
+                return relative_base + parameter;
+            case ParamMode::immediate:
+                throw std::invalid_argument("write operands cannot be in immediate mode");
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+
+  public:
+    // Instructions executed over the computer's lifetime.
+    uint64_t executed = 0;
+
+    Computer(Program p) : p(std::move(p)) {};
+
+    bool is_halted() const {
+        return halted;
+    }
+
+    /**
+     * Executes until the program halts, `env.input()` returns nullopt or
+     * `env.output(value)` returns false; the instruction that stopped is run
+     * again on the next call. The environment is a template parameter so that
+     * both calls are inlined into the loop (see day11.cpp).
+     */
+    template <typename Env> Stop run(Env &env) {
+        assert(!halted);
+        uint64_t steps = 0;
+        struct Commit {
+            uint64_t &executed;
+            uint64_t &steps;
+            ~Commit() {
+                executed += steps;
+            }
+        } commit{executed, steps};
+
+        while (true) {
+            auto in = Instruction::parse(p.read(pc));
+            steps++;
+
+            switch (in.opcode) {
+                case Opcode::halt: {
+                    halted = true;
+                    return Stop::halted;
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 + arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 * arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    auto arg1 = eval_write_operand(p.read(pc + 1), in.mode1);
+                    auto value = env.input();
+                    if (!value) {
+                        steps--;
+                        return Stop::needs_input;
+                    }
+                    p.write(arg1, *value);
+                    pc += 2;
+                    break;
+                }
+                case Opcode::output: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    if (!env.output(arg1)) {
+                        steps--;
+                        return Stop::output_full;
+                    }
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 != 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 == 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 < arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 == arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    relative_base += arg1;
+                    pc += 2;
+                    break;
+                }
+                default: {
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.read(pc)));
+                }
+            }
+        }
+    }
+};
+
+/**
+ * The in-process path: inputs from one queue, outputs to another.
+ */
+struct QueueEnv {
+    std::deque<code> &inputs;
+    std::deque<code> &outputs;
+
+    std::optional<code> input() {
+        if (inputs.empty())
+            return std::nullopt;
+        auto x = inputs.front();
+        inputs.pop_front();
+        return x;
+    }
+    bool output(code x) {
+        outputs.push_back(x);
+        return true;
+    }
+};
+
+/**
+ * The shared part of a ring. The producer's and the consumer's counters live
+ * on separate cache lines so that neither side's stores invalidate the line
+ * the other one is polling; the flags share a third.
+ */
+struct RingHeader {
+    // Values ever written; advanced only by the producer.
+    alignas(64) std::atomic<uint64_t> head;
+    // Values ever read; advanced only by the consumer.
+    alignas(64) std::atomic<uint64_t> tail;
+    // Set by a side about to sleep on its eventfd, cleared by whoever wakes it.
+    alignas(64) std::atomic<uint32_t> reader_waiting;
+    std::atomic<uint32_t> writer_waiting;
+    // Set once a side is gone for good: a halted producer, or a consumer that
+    // halted or failed.
+    std::atomic<uint32_t> writer_closed;
+    std::atomic<uint32_t> reader_closed;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free, "ring counters must be address-free");
+
+/**
+ * A single-producer, single-consumer ring of words in memory shared between
+ * processes, with an eventfd in each direction for when one side has to wait
+ * for the other. This is only the shared state; Writer and Reader keep the
+ * per-end state of the process using that end.
+ */
+struct Ring {
+    RingHeader *header;
+    code *slots;
+    uint64_t capacity;
+    // Signalled when values are written or the writer closes.
+    int readable;
+    // Signalled when values are read or the reader closes.
+    int writable;
+
+    static void signal(int fd) {
+        eventfd_write(fd, 1);
+    }
+    static void drain(int fd) {
+        eventfd_t count;
+        eventfd_read(fd, &count);
+    }
+};
+
+/**
+ * The producing end of a ring. Values are written straight into the shared
+ * slots and published one at a time, each followed by a check for a consumer
+ * that went to sleep waiting for it; the consumer's tail is only read again
+ * when the ring looks full.
+ */
+class Writer {
+  private:
+    Ring ring;
+    uint64_t head;
+    // The head may run up to here before the consumer's tail is read again.
+    uint64_t limit;
+
+  public:
+    Writer(Ring ring) : ring(ring), head(ring.header->head.load()), limit(ring.header->tail.load() + ring.capacity) {};
+
+    bool push(code x) {
+        if (head == limit) {
+            limit = ring.header->tail.load(std::memory_order_acquire) + ring.capacity;
+            if (head == limit)
+                return false;
+        }
+        ring.slots[head & (ring.capacity - 1)] = x;
+        ring.header->head.store(++head, std::memory_order_release);
+        wake();
+        return true;
+    }
+
+  private:
+    void wake() {
+        // Pairs with the fence in Reader::prepare_wait: either the consumer
+        // sees the new head, or we see its flag.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.header->reader_waiting.load(std::memory_order_relaxed) && ring.header->reader_waiting.exchange(0))
+            Ring::signal(ring.readable);
+    }
+
+  public:
+    void close() {
+        ring.header->writer_closed.store(1, std::memory_order_release);
+        ring.header->reader_waiting.store(0);
+        Ring::signal(ring.readable);
+    }
+    bool is_reader_closed() const {
+        return ring.header->reader_closed.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Announces that this side will sleep until there is room. Returns false
+     * if there already is (or the reader is gone), in which case it must not.
+     */
+    bool prepare_wait() {
+        ring.header->writer_waiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.header->tail.load(std::memory_order_acquire) + ring.capacity != head || is_reader_closed()) {
+            ring.header->writer_waiting.store(0);
+            return false;
+        }
+        return true;
+    }
+    int fd() const {
+        return ring.writable;
+    }
+    void finish_wait() {
+        ring.header->writer_waiting.store(0);
+        Ring::drain(ring.writable);
+    }
+};
+
+/**
+ * The consuming end of a ring: the mirror image of Writer.
+ */
+class Reader {
+  private:
+    Ring ring;
+    uint64_t tail;
+    // Values up to here are known to be published.
+    uint64_t available;
+
+  public:
+    Reader(Ring ring) : ring(ring), tail(ring.header->tail.load()), available(ring.header->head.load()) {};
+
+    std::optional<code> pop() {
+        if (tail == available) {
+            available = ring.header->head.load(std::memory_order_acquire);
+            if (tail == available)
+                return std::nullopt;
+        }
+        auto x = ring.slots[tail & (ring.capacity - 1)];
+        ring.header->tail.store(++tail, std::memory_order_release);
+        wake();
+        return x;
+    }
+
+  private:
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.header->writer_waiting.load(std::memory_order_relaxed) && ring.header->writer_waiting.exchange(0))
+            Ring::signal(ring.writable);
+    }
+
+  public:
+    void close() {
+        ring.header->reader_closed.store(1, std::memory_order_release);
+        ring.header->writer_waiting.store(0);
+        Ring::signal(ring.writable);
+    }
+    /**
+     * Whether nothing more can arrive: the writer closed and everything it
+     * wrote has been read.
+     */
+    bool is_exhausted() {
+        return ring.header->writer_closed.load(std::memory_order_acquire) && ring.header->head.load(std::memory_order_acquire) == tail;
+    }
+
+    bool prepare_wait() {
+        ring.header->reader_waiting.store(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (ring.header->head.load(std::memory_order_acquire) != tail || ring.header->writer_closed.load(std::memory_order_acquire)) {
+            ring.header->reader_waiting.store(0);
+            return false;
+        }
+        return true;
+    }
+    int fd() const {
+        return ring.readable;
+    }
+    void finish_wait() {
+        ring.header->reader_waiting.store(0);
+        Ring::drain(ring.readable);
+    }
+};
+
+/**
+ * Connects a computer to its two ring ends. Inputs are read out of the
+ * producer's slots and outputs written into the consumer's, with no copy in
+ * between.
+ */
+struct RingEnv {
+    Reader &in;
+    Writer &out;
+
+    std::optional<code> input() {
+        return in.pop();
+    }
+    bool output(code x) {
+        return out.push(x);
+    }
+};
+
+/**
+ * All rings of a fleet in one memfd mapping, created before the workers are
+ * forked so that every process sees them at the same address. Each ring's
+ * header is followed by its slots.
+ */
+class RingSet {
+  private:
+    void *mapping = nullptr;
+    std::size_t bytes = 0;
+
+  public:
+    std::vector<Ring> rings{};
+
+    RingSet(std::size_t count, uint64_t capacity) {
+        auto stride = (sizeof(RingHeader) + capacity * sizeof(code) + 63) / 64 * 64;
+        bytes = std::max<std::size_t>(count * stride, 1);
+        auto fd = memfd_create("intcode-fleet", MFD_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "creating the ring memory");
+        if (ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            close(fd);
+            throw std::system_error(errno, std::generic_category(), "sizing the ring memory");
+        }
+        mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping the ring memory");
+        for (std::size_t i = 0; i < count; i++) {
+            auto base = static_cast<char *>(mapping) + i * stride;
+            auto header = new (base) RingHeader{};
+            auto readable = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            auto writable = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (readable < 0 || writable < 0)
+                throw std::system_error(errno, std::generic_category(), "creating a ring eventfd");
+            rings.push_back(Ring{header, reinterpret_cast<code *>(base + sizeof(RingHeader)), capacity, readable, writable});
+        }
+    }
+    RingSet(const RingSet &) = delete;
+    ~RingSet() {
+        for (auto &ring : rings) {
+            close(ring.readable);
+            close(ring.writable);
+        }
+        munmap(mapping, bytes);
+    }
+};
+
+/**
+ * A fleet: computers each reading from ring `inputs[i]` and writing to ring
+ * `outputs[i]`. `seeds` are written into rings before anything runs.
+ */
+struct Topology {
+    std::vector<Program> programs;
+    std::vector<std::size_t> inputs;
+    std::vector<std::size_t> outputs;
+    std::size_t ring_count;
+    std::vector<std::pair<std::size_t, std::vector<code>>> seeds{};
+};
+
+/**
+ * Runs computers `first` to `last` - 1 of the fleet in this process until
+ * every one of them has halted or can never run again: blocked on input from a
+ * closed, empty ring, or on output to a ring whose reader is gone. Computers
+ * are run in turn until none makes progress, and then the process sleeps on
+ * the eventfds of the rings they are blocked on. Returns whether all of them
+ * got there without an error.
+ */
+bool work(const Topology &topology, RingSet &rings, std::size_t first, std::size_t last) {
+    struct Node {
+        std::size_t id;
+        Computer computer;
+        Reader in;
+        Writer out;
+        Stop stop = Stop::needs_input;
+        bool done = false;
+    };
+    std::vector<Node> nodes{};
+    for (auto i = first; i < last; i++)
+        nodes.push_back(Node{i, Computer(topology.programs[i]), Reader(rings.rings[topology.inputs[i]]), Writer(rings.rings[topology.outputs[i]])});
+
+    bool ok = true;
+    auto finish = [&](Node &node) {
+        node.done = true;
+        node.in.close();
+        node.out.close();
+    };
+    std::vector<pollfd> fds{};
+    while (true) {
+        bool progress = false;
+        bool all_done = true;
+        for (auto &node : nodes) {
+            if (node.done)
+                continue;
+            auto before = node.computer.executed;
+            try {
+                RingEnv env{node.in, node.out};
+                node.stop = node.computer.run(env);
+            } catch (std::exception &e) {
+                std::cerr << std::format("fleet: vm {}: {}", node.id, e.what()) << std::endl;
+                ok = false;
+                finish(node);
+                continue;
+            }
+            progress |= node.computer.executed != before;
+            if (node.stop == Stop::halted || (node.stop == Stop::needs_input && node.in.is_exhausted()) || (node.stop == Stop::output_full && node.out.is_reader_closed()))
+                finish(node);
+            else
+                all_done = false;
+        }
+        if (all_done)
+            return ok;
+        if (progress)
+            continue;
+
+        fds.clear();
+        bool ready = false;
+        for (auto &node : nodes) {
+            if (node.done)
+                continue;
+            if (node.stop == Stop::needs_input ? !node.in.prepare_wait() : !node.out.prepare_wait())
+                ready = true;
+            fds.push_back(pollfd{node.stop == Stop::needs_input ? node.in.fd() : node.out.fd(), POLLIN, 0});
+        }
+        if (!ready)
+            poll(fds.data(), fds.size(), -1);
+        for (auto &node : nodes) {
+            if (node.done)
+                continue;
+            if (node.stop == Stop::needs_input)
+                node.in.finish_wait();
+            else
+                node.out.finish_wait();
+        }
+    }
+}
+
+/**
+ * Runs the fleet over `procs` processes, each taking a contiguous share of the
+ * computers. `drive` runs in the calling process meanwhile, for feeding and
+ * draining rings that have no computer at one end. Returns whether every
+ * worker succeeded.
+ */
+bool launch(const Topology &topology, RingSet &rings, std::size_t procs, const std::function<void()> &drive) {
+    for (auto &[ring, values] : topology.seeds) {
+        Writer seed(rings.rings[ring]);
+        for (auto x : values) {
+            if (!seed.push(x))
+                throw std::invalid_argument(std::format("{} seed values do not fit in a ring of {}", values.size(), rings.rings[ring].capacity));
+        }
+    }
+
+    auto count = topology.programs.size();
+    procs = std::clamp<std::size_t>(procs, 1, std::max<std::size_t>(count, 1));
+    std::vector<pid_t> children{};
+    for (std::size_t p = 0; p < procs; p++) {
+        auto pid = fork();
+        if (pid < 0)
+            throw std::system_error(errno, std::generic_category(), "forking a worker");
+        if (pid == 0) {
+            auto ok = work(topology, rings, p * count / procs, (p + 1) * count / procs);
+            std::cout.flush();
+            _exit(ok ? 0 : 1);
+        }
+        children.push_back(pid);
+    }
+    drive();
+    bool ok = true;
+    for (auto pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok;
+}
+
+/**
+ * Reads `n` relay hops, then passes `n` values from input to output and
+ * halts.
+ */
+const std::vector<code> RELAY{3, 100, 3, 101, 4, 101, 1001, 100, -1, 100, 1005, 100, 2, 99};
+
+/**
+ * Two relays in a loop with `in_flight` values circulating, `messages` hops
+ * each way. The first relay also passes on the values it was seeded with, so
+ * both halt with those left in the second one's input ring.
+ */
+Topology relay_pair(uint64_t messages, uint64_t in_flight) {
+    Program relay(RELAY);
+    Topology topology{{relay, relay}, {0, 1}, {1, 0}, 2};
+    std::vector<code> first{static_cast<code>(messages + in_flight)};
+    first.insert(first.end(), in_flight, 1);
+    topology.seeds.emplace_back(0, std::move(first));
+    topology.seeds.emplace_back(1, std::vector<code>{static_cast<code>(messages)});
+    return topology;
+}
+
+/**
+ * Times the relay pair over in-process queues, over rings within one process
+ * and over rings between two processes, for a single value in flight
+ * (latency) and for many (throughput).
+ */
+int bench(uint64_t messages, uint64_t capacity) {
+    std::cout << std::format("{:<18} {:>9} {:>12} {:>14}", "transport", "in-flight", "ns/message", "messages/s") << std::endl;
+    for (uint64_t in_flight : {uint64_t{1}, uint64_t{16}, capacity / 2}) {
+        auto report = [&](std::string_view name, auto run) {
+            auto start = std::chrono::steady_clock::now();
+            if (!run())
+                throw std::runtime_error(std::format("{} failed", name));
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            auto hops = 2.0 * static_cast<double>(messages);
+            std::cout << std::format("{:<18} {:>9} {:>12.1f} {:>14.0f}", name, in_flight, elapsed.count() * 1e9 / hops, hops / elapsed.count()) << std::endl;
+        };
+        report("queue, 1 process", [&] {
+            auto topology = relay_pair(messages, in_flight);
+            std::vector<std::deque<code>> queues(2);
+            for (auto &[ring, values] : topology.seeds)
+                queues[ring].insert(queues[ring].end(), values.begin(), values.end());
+            Computer a(topology.programs[0]), b(topology.programs[1]);
+            QueueEnv to_b{queues[0], queues[1]}, to_a{queues[1], queues[0]};
+            while (!a.is_halted() || !b.is_halted()) {
+                if (!a.is_halted())
+                    a.run(to_b);
+                if (!b.is_halted())
+                    b.run(to_a);
+            }
+            return true;
+        });
+        for (std::size_t procs : {1, 2}) {
+            report(std::format("ring, {} process{}", procs, procs > 1 ? "es" : ""), [&] {
+                auto topology = relay_pair(messages, in_flight);
+                RingSet rings(topology.ring_count, capacity);
+                return launch(topology, rings, procs, [] {});
+            });
+        }
+    }
+    return 0;
+}
+
+/**
+ * Usage: fleet [--procs N] [--ring WORDS] [--seed VM=A,B,...] [--loop] PROGRAM...
+ *        fleet --bench [--messages N] [--ring WORDS]
+ *
+ * Runs one computer per PROGRAM, spread over N worker processes (default: one
+ * per CPU), with each computer's outputs connected to the next one's inputs
+ * through a ring in shared memory. stdin feeds the first computer and the last
+ * one's outputs go to stdout, one value per line, unless --loop connects the
+ * last back to the first, in which case stdin is only the first's initial
+ * input and the last value the last computer wrote is printed when all halt
+ * (day07's feedback loop). --seed queues values for computer VM before the
+ * rest, e.g. day07 phase settings.
+ *
+ * A computer stops for good when it halts, fails, or waits on a ring whose
+ * other end already has. Rings hold WORDS values (default 4096, a power of
+ * two); all the values in flight into one computer must fit.
+ *
+ * --bench passes N messages (default 1000000) back and forth between two
+ * relays and reports the time per message over in-process queues, over rings
+ * in one process and over rings between two processes.
+ */
+int main(int argc, char **argv) {
+    std::size_t procs = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t capacity = 4096;
+    uint64_t messages = 1000000;
+    bool loop = false;
+    bool benchmark = false;
+    std::vector<std::pair<std::size_t, std::vector<code>>> seeds{};
+    std::vector<std::string> paths{};
+    auto usage = [] {
+        std::cerr << "usage: fleet [--procs N] [--ring WORDS] [--seed VM=A,B,...] [--loop] PROGRAM...\n"
+                     "       fleet --bench [--messages N] [--ring WORDS]"
+                  << std::endl;
+        return 2;
+    };
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg == "--procs" && i + 1 < argc) {
+                procs = std::max(1, std::stoi(argv[++i]));
+            } else if (arg == "--ring" && i + 1 < argc) {
+                capacity = std::stoull(argv[++i]);
+            } else if (arg == "--messages" && i + 1 < argc) {
+                messages = std::stoull(argv[++i]);
+            } else if (arg == "--seed" && i + 1 < argc) {
+                std::string seed = argv[++i];
+                auto equals = seed.find('=');
+                if (equals == std::string::npos)
+                    return usage();
+                std::vector<code> values{};
+                std::istringstream stream(seed.substr(equals + 1));
+                for (std::string part; std::getline(stream, part, ',');)
+                    values.push_back(std::stol(part));
+                seeds.emplace_back(std::stoul(seed.substr(0, equals)), std::move(values));
+            } else if (arg == "--loop") {
+                loop = true;
+            } else if (arg == "--bench") {
+                benchmark = true;
+            } else if (!arg.starts_with("--")) {
+                paths.push_back(arg);
+            } else {
+                std::cerr << std::format("unknown argument {}", arg) << std::endl;
+                return 2;
+            }
+        }
+    } catch (std::exception &) {
+        return usage();
+    }
+    if (benchmark == !paths.empty() || capacity < 4 || (capacity & (capacity - 1)) != 0)
+        return usage();
+    for (auto &[vm, values] : seeds) {
+        if (vm >= paths.size())
+            return usage();
+    }
+
+    try {
+        if (benchmark)
+            return bench(messages, capacity);
+
+        Topology topology{{}, {}, {}, loop ? paths.size() : paths.size() + 1};
+        for (std::size_t i = 0; i < paths.size(); i++) {
+            std::ifstream file(paths[i]);
+            if (!file) {
+                std::cerr << std::format("cannot open {}", paths[i]) << std::endl;
+                return 2;
+            }
+            topology.programs.push_back(Program::parse(file));
+            topology.inputs.push_back(i);
+            topology.outputs.push_back((i + 1) % topology.ring_count);
+        }
+        topology.seeds = std::move(seeds);
+        std::vector<code> stdin_values{};
+        for (code x; std::cin >> x;)
+            stdin_values.push_back(x);
+
+        RingSet rings(topology.ring_count, capacity);
+        if (loop) {
+            topology.seeds.emplace_back(0, std::move(stdin_values));
+            // Everything the last computer wrote stays in the first one's
+            // ring, read or not, so its last value is still there at the end.
+            auto ok = launch(topology, rings, procs, [] {});
+            auto &ring = rings.rings[0];
+            auto head = ring.header->head.load();
+            if (head > 0)
+                std::cout << ring.slots[(head - 1) & (ring.capacity - 1)] << std::endl;
+            return ok ? 0 : 1;
+        }
+
+        // Feeds stdin to the first computer and prints the last one's outputs
+        // until it is done.
+        auto drive = [&] {
+            Writer feed(rings.rings[0]);
+            Reader drain(rings.rings[paths.size()]);
+            std::size_t fed = 0;
+            bool closed = false;
+            while (true) {
+                while (fed < stdin_values.size() && !feed.is_reader_closed() && feed.push(stdin_values[fed]))
+                    fed++;
+                if (!closed && (fed == stdin_values.size() || feed.is_reader_closed())) {
+                    feed.close();
+                    closed = true;
+                    fed = stdin_values.size();
+                }
+                bool drained = false;
+                while (auto x = drain.pop()) {
+                    std::cout << *x << "\n";
+                    drained = true;
+                }
+                if (drain.is_exhausted())
+                    break;
+                if (drained)
+                    continue;
+                std::cout.flush();
+                pollfd fds[2]{{drain.fd(), POLLIN, 0}, {feed.fd(), POLLIN, 0}};
+                auto waiting_to_feed = fed < stdin_values.size();
+                if (drain.prepare_wait() && (!waiting_to_feed || feed.prepare_wait()))
+                    poll(fds, waiting_to_feed ? 2 : 1, -1);
+                drain.finish_wait();
+                if (waiting_to_feed)
+                    feed.finish_wait();
+            }
+            drain.close();
+            std::cout.flush();
+        };
+        return launch(topology, rings, procs, drive) ? 0 : 1;
+    } catch (std::exception &e) {
+        std::cerr << std::format("fleet: {}", e.what()) << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,1306 @@
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class Opcode {
+    add = 1,
+    mul = 2,
+    input = 3,
+    output = 4,
+    jump_true = 5,
+    jump_false = 6,
+    less_than = 7,
+    equals = 8,
+    relative_base = 9,
+    halt = 99,
+};
+
+enum class ParamMode {
+    position = 0,
+    immediate = 1,
+    relative = 2,
+};
+
+typedef long code;
+
+/**
+ * Raised when the program touches an address outside of its memory, i.e. not
+ * in [0, 2^31).
+ */
+class MemoryFault : public std::out_of_range {
+  public:
+    code address;
+    MemoryFault(code address) : std::out_of_range(std::format("memory fault at address {}", address)), address(address) {};
+};
+
+/**
+ * The reference's memory, deliberately unlike the engines' growing mapping: a
+ * vector that grows on write, with words far past the program kept in a map
+ * so that a stray store does not allocate gigabytes. Addresses are compared
+ * whole against the 2^31 words every engine has, never truncated, so 2^32+k
+ * is a fault here rather than another name for k.
+ */
+class Program {
+  private:
+    static constexpr code WORDS = code{1} << 31;
+    static constexpr std::size_t DENSE = std::size_t{1} << 20;
+
+    std::vector<code> memory;
+    std::map<code, code> sparse{};
+
+  public:
+    Program(std::vector<code> memory) : memory(std::move(memory)) {};
+
+    code read(code index) const {
+        if (index < 0 || index >= WORDS)
+            throw MemoryFault(index);
+        if (static_cast<std::size_t>(index) < memory.size())
+            return memory[index];
+        auto it = sparse.find(index);
+        return it == sparse.end() ? 0 : it->second;
+    }
+    void write(code index, code value) {
+        if (index < 0 || index >= WORDS)
+            throw MemoryFault(index);
+        if (static_cast<std::size_t>(index) >= memory.size() && static_cast<std::size_t>(index) < DENSE)
+            memory.resize(index + 1);
+        if (static_cast<std::size_t>(index) < memory.size())
+            memory[index] = value;
+        else
+            sparse[index] = value;
+    }
+
+    /**
+     * Calls `f(address, value)` for every nonzero word, in address order.
+     */
+    template <typename F> void for_each_word(F f) const {
+        for (std::size_t i = 0; i < memory.size(); i++)
+            if (memory[i] != 0)
+                f(static_cast<code>(i), memory[i]);
+        for (auto [address, value] : sparse)
+            if (value != 0)
+                f(address, value);
+    }
+};
+
+class Instruction {
+  public:
+    Opcode opcode;
+    ParamMode mode1;
+    ParamMode mode2;
+    ParamMode mode3;
+    static Instruction parse(code x) {
+        return Instruction(Opcode(x % 100), ParamMode((x / 100) % 10), ParamMode((x / 1000) % 10), ParamMode((x / 10000) % 10));
+    };
+};
+
+/**
+ * How a run ended. `blocked` is waiting for an input that was never given,
+ * which the runner treats as the normal end of its input stream.
+ */
+enum class End { halted, blocked, fault, invalid, timeout, crashed };
+
+std::string_view end_name(End end) {
+    switch (end) {
+        case End::halted:
+            return "halted";
+        case End::blocked:
+            return "blocked";
+        case End::fault:
+            return "memory fault";
+        case End::invalid:
+            return "invalid instruction";
+        case End::timeout:
+            return "timeout";
+        default:
+            return "crashed";
+    }
+}
+
+/**
+ * The reference: the plain switch interpreter from day09.cpp, less the trace,
+ * over the memory above, with a step budget so generated programs that never
+ * stop can be dropped, and so that it can stop where `runner --steps` does.
+ */
+class Computer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+    code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return p.read(parameter);
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return p.read(relative_base + parameter);
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return parameter;
+            case ParamMode::relative:
+                return relative_base + parameter;
+            case ParamMode::immediate:
+                throw std::invalid_argument("write operands cannot be in immediate mode");
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+
+  public:
+    // Instructions executed, counted as the runner counts them: the halt and
+    // a failing instruction are included, an input that blocks is not.
+    uint64_t executed = 0;
+
+    Computer(Program p) : p(std::move(p)) {};
+
+    code where() const {
+        return pc;
+    }
+    code peek(code address) const {
+        return p.read(address);
+    }
+    void poke(code address, code value) {
+        p.write(address, value);
+    }
+
+    /**
+     * Executes until the program halts, needs an input that `input` cannot
+     * supply, or has executed `budget` instructions in all.
+     */
+    End run(std::deque<code> &input, std::vector<code> &output, uint64_t budget) {
+        assert(!halted);
+
+        while (true) {
+            if (executed >= budget)
+                return End::timeout;
+            auto in = Instruction::parse(p.read(pc));
+            executed++;
+
+            switch (in.opcode) {
+                case Opcode::halt: {
+                    halted = true;
+                    return End::halted;
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 + arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 * arg2);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty()) {
+                        executed--;
+                        return End::blocked;
+                    }
+                    auto arg1 = eval_write_operand(p.read(pc + 1), in.mode1);
+                    p.write(arg1, input.front());
+                    pc += 2;
+                    input.pop_front();
+                    break;
+                }
+                case Opcode::output: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    output.push_back(arg1);
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 != 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    pc = arg1 == 0 ? arg2 : pc + 3;
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 < arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand(p.read(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(p.read(pc + 3), in.mode3);
+                    p.write(arg3, arg1 == arg2 ? 1 : 0);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    auto arg1 = eval_read_operand(p.read(pc + 1), in.mode1);
+                    relative_base += arg1;
+                    pc += 2;
+                    break;
+                }
+                default: {
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.read(pc)));
+                }
+            }
+        }
+    }
+
+    /**
+     * The machine state in the format of `runner --dump-memory`.
+     */
+    std::string dump() const {
+        std::string out = std::format("pc {}\nrelative_base {}\nhalted {}\n", pc, relative_base, halted ? 1 : 0);
+        p.for_each_word([&](code address, code value) { out += std::format("{} {}\n", address, value); });
+        return out;
+    }
+};
+
+struct Case {
+    std::vector<code> program;
+    std::vector<code> input;
+};
+
+/**
+ * What a run produced. `state` is the dump of the machine where it stopped,
+ * after a failure with pc at the failing instruction. `steps` is the number of
+ * instructions executed, where the engine reports it.
+ */
+struct Outcome {
+    End end;
+    std::vector<code> output;
+    std::string state;
+    uint64_t steps = 0;
+};
+
+const uint64_t BUDGET = 100'000;
+
+/**
+ * Runs a case on the reference. With a `budget` below the case's length, it
+ * ends in End::timeout at the state after that many instructions.
+ */
+Outcome reference(const Case &c, uint64_t budget = BUDGET) {
+    Computer computer{Program(c.program)};
+    std::deque<code> input(c.input.begin(), c.input.end());
+    Outcome outcome{End::halted, {}, {}};
+    try {
+        outcome.end = computer.run(input, outcome.output, budget);
+    } catch (MemoryFault &) {
+        outcome.end = End::fault;
+    } catch (std::invalid_argument &) {
+        outcome.end = End::invalid;
+    }
+    outcome.state = computer.dump();
+    outcome.steps = computer.executed;
+    return outcome;
+}
+
+/**
+ * Random programs that are valid to the point of decoding: real opcodes, no
+ * immediate-mode writes. Besides single random instructions the body mixes in
+ * the shapes the fast paths look for: counted loops (day09 --accelerate),
+ * calls under the relative-base convention (--memoize) and instructions that
+ * patch later code (the code cache). Operands now and then reach far away
+ * addresses: the top of the cached range, negative addresses, or the end of
+ * memory and past it, including 2^32 plus an address in the program, which
+ * an engine that truncates addresses would alias onto the code. Those, jumps
+ * into the middle of instructions, writes over the code and a negative
+ * relative base are kept rare, and most jumps go forward, so that most cases
+ * run to a normal end rather than stop at their first odd instruction or loop
+ * past the step budget.
+ */
+class Generator {
+  private:
+    std::mt19937_64 rng;
+    // Writes stay below 2^25 so a dump of memory only has to scan 256 MiB.
+    static constexpr code FAR = code{1} << 24;
+    // Data starts with globals, then loop counters, then 32 words that random
+    // instructions mostly write to, so that they seldom break a loop.
+    static constexpr code COUNTERS = 8;
+    static constexpr code SCRATCH = 32;
+
+    struct Fixup {
+        std::size_t at;
+        std::size_t label;
+    };
+    std::vector<code> words{};
+    std::vector<code> starts{};
+    std::vector<code> labels{};
+    std::vector<Fixup> fixups{};
+    // Labels to resolve to the start of a random piece of the body once it is
+    // done, with where the jump to them ends.
+    std::vector<std::pair<std::size_t, code>> targets{};
+    // Patches to apply once the body is laid out: the word holding the value,
+    // the word holding the address, and the instruction start to patch.
+    std::vector<std::tuple<std::size_t, std::size_t, std::size_t>> patches{};
+    code data = 0;
+
+    code uniform(code lo, code hi) {
+        return std::uniform_int_distribution<code>(lo, hi)(rng);
+    }
+    bool chance(double p) {
+        return std::bernoulli_distribution(p)(rng);
+    }
+
+    std::size_t label() {
+        labels.push_back(-1);
+        return labels.size() - 1;
+    }
+    void place(std::size_t label) {
+        labels[label] = words.size();
+    }
+    void emit(std::initializer_list<code> instruction) {
+        starts.push_back(words.size());
+        words.insert(words.end(), instruction);
+    }
+    void refer(std::size_t offset, std::size_t label) {
+        fixups.push_back({words.size() - offset, label});
+    }
+
+    code far_address() {
+        switch (uniform(0, 4)) {
+            case 0:
+                return FAR + uniform(-8, 8);
+            case 1:
+                return (code{1} << 31) - uniform(1, 8);
+            case 2:
+                return -uniform(1, 8);
+            case 3:
+                return (code{1} << (chance(0.5) ? 31 : 32)) + uniform(0, data);
+            default:
+                return uniform(0, code{1} << 31);
+        }
+    }
+    code read_parameter(ParamMode mode) {
+        switch (mode) {
+            case ParamMode::immediate:
+                return chance(0.05) ? uniform(-(1 << 20), 1 << 20) : uniform(-20, 60);
+            case ParamMode::relative:
+                return chance(0.02) ? uniform(-8, -1) : uniform(0, 24);
+            default:
+                return chance(0.01) ? far_address() : uniform(0, data + SCRATCH + 32);
+        }
+    }
+    code write_parameter(ParamMode mode) {
+        if (mode == ParamMode::relative)
+            return chance(0.02) ? uniform(-8, -1) : uniform(0, 24);
+        if (!chance(0.01))
+            return chance(0.9) ? uniform(data + SCRATCH, data + SCRATCH + 31) : uniform(0, data + SCRATCH + 31);
+        // Far writes stay at the edge of the cache, or fault.
+        switch (uniform(0, 2)) {
+            case 0:
+                return FAR + uniform(-8, 8);
+            case 1:
+                return -uniform(1, 8);
+            default:
+                return (code{1} << 32) + uniform(0, data);
+        }
+    }
+    ParamMode read_mode() {
+        return ParamMode(uniform(0, 2));
+    }
+    ParamMode write_mode() {
+        return chance(0.7) ? ParamMode::position : ParamMode::relative;
+    }
+    static code word(code opcode, ParamMode m1, ParamMode m2 = ParamMode::position, ParamMode m3 = ParamMode::position) {
+        return opcode + 100 * static_cast<code>(m1) + 1000 * static_cast<code>(m2) + 10000 * static_cast<code>(m3);
+    }
+
+    void random_instruction() {
+        static const code opcodes[] = {1, 1, 2, 7, 8, 3, 4, 4, 5, 6, 9};
+        auto opcode = opcodes[uniform(0, std::size(opcodes) - 1)];
+        switch (opcode) {
+            case 3: {
+                auto m = write_mode();
+                emit({word(3, m), write_parameter(m)});
+                break;
+            }
+            case 4: {
+                auto m = read_mode();
+                emit({word(4, m), read_parameter(m)});
+                break;
+            }
+            case 5:
+            case 6: {
+                // Mostly to the start of a piece, rarely anywhere.
+                auto m1 = read_mode();
+                if (chance(0.95)) {
+                    emit({word(opcode, m1, ParamMode::immediate), read_parameter(m1), 0});
+                    refer(1, random_target());
+                } else {
+                    auto m2 = read_mode();
+                    emit({word(opcode, m1, m2), read_parameter(m1), m2 == ParamMode::immediate && chance(0.2) ? far_address() : read_parameter(m2)});
+                }
+                break;
+            }
+            case 9: {
+                // Mostly a small step up, which keeps frames in the data.
+                auto m = chance(0.8) ? ParamMode::immediate : read_mode();
+                code delta = 0;
+                if (m != ParamMode::immediate)
+                    delta = read_parameter(m);
+                else if (chance(0.02))
+                    delta = chance(0.5) ? FAR : -FAR;
+                else
+                    delta = chance(0.1) ? uniform(-16, -1) : uniform(0, 16);
+                emit({word(9, m), delta});
+                break;
+            }
+            default: {
+                auto m1 = read_mode(), m2 = read_mode(), m3 = write_mode();
+                emit({word(opcode, m1, m2, m3), read_parameter(m1), read_parameter(m2), write_parameter(m3)});
+                break;
+            }
+        }
+    }
+    std::size_t random_target() {
+        auto l = label();
+        targets.push_back({l, static_cast<code>(words.size())});
+        return l;
+    }
+
+    /**
+     * x = init; do x += step; while (x < bound), or with equals when the
+     * bound is reachable exactly.
+     */
+    void counted_loop() {
+        auto x = uniform(data + COUNTERS, data + SCRATCH - 2), t = uniform(x + 1, data + SCRATCH - 1);
+        auto step = uniform(1, 5), init = uniform(-30, 30), trips = uniform(1, 40);
+        emit({1101, 0, init, x});
+        auto top = label();
+        place(top);
+        emit({1001, x, step, x});
+        if (chance(0.5)) {
+            emit({1007, x, init + step * trips, t});
+            emit({1005, t, 0});
+        } else {
+            emit({1008, x, init + step * trips, t});
+            emit({1006, t, 0});
+        }
+        refer(1, top);
+    }
+
+    // A handful of globals, so that functions and their callers share some.
+    code global() {
+        return uniform(data, data + COUNTERS - 1);
+    }
+
+    /**
+     * A function of one argument in a fresh frame: the caller stores the
+     * return address and the argument above its relative base, moves the
+     * base by 4 and jumps; the callee computes into its frame and jumps back
+     * through the saved address. The frame size is sometimes read from a
+     * global rather than given as an immediate.
+     */
+    void call(std::vector<std::size_t> &functions) {
+        auto back = label();
+        emit({21101, 0, 0, 1});
+        refer(2, back);
+        auto m = read_mode();
+        emit({word(1, m, ParamMode::immediate, ParamMode::relative), read_parameter(m), 0, 2});
+        if (chance(0.3)) {
+            auto size = global();
+            emit({1101, 4, 0, size});
+            emit({9, size});
+        } else {
+            emit({109, 4});
+        }
+        auto function = label();
+        emit({1105, 1, 0});
+        refer(1, function);
+        place(back);
+        emit({109, -4});
+        emit({204, 0});
+        functions.push_back(function);
+    }
+
+    /**
+     * One call site run a few times, with a global bumped and the relative
+     * base moved in between: a memoized call is then looked up at another
+     * base, against globals that may have changed.
+     */
+    void repeated_call(std::vector<std::size_t> &functions) {
+        auto counter = uniform(data + COUNTERS, data + SCRATCH - 2), t = uniform(counter + 1, data + SCRATCH - 1);
+        emit({1101, 0, 0, counter});
+        auto top = label();
+        place(top);
+        call(functions);
+        auto g = global();
+        emit({101, uniform(1, 3), g, g});
+        emit({109, uniform(1, 8)});
+        emit({1001, counter, 1, counter});
+        emit({1007, counter, uniform(2, 4), t});
+        emit({1005, t, 0});
+        refer(1, top);
+    }
+
+    /**
+     * Computes into the frame from the argument, constants and globals, which
+     * it reaches in position mode and now and then also writes.
+     */
+    void function_body(std::size_t function) {
+        place(function);
+        auto steps = uniform(1, 4);
+        for (code i = 0; i < steps; i++) {
+            static const code opcodes[] = {1, 2, 7, 8};
+            static const ParamMode modes[] = {ParamMode::relative, ParamMode::immediate, ParamMode::position};
+            auto opcode = opcodes[uniform(0, 3)];
+            auto m1 = modes[uniform(0, 2)], m2 = modes[uniform(0, 2)];
+            auto m3 = chance(0.2) ? ParamMode::position : ParamMode::relative;
+            auto operand = [&](ParamMode m) {
+                switch (m) {
+                    case ParamMode::relative:
+                        return uniform(-2, 0);
+                    case ParamMode::immediate:
+                        return uniform(-5, 9);
+                    default:
+                        return global();
+                }
+            };
+            emit({word(opcode, m1, m2, m3), operand(m1), operand(m2), m3 == ParamMode::position ? global() : -4});
+        }
+        emit({2105, 1, -3});
+    }
+
+    /**
+     * Overwrites the opcode word of some instruction with one of the same
+     * width: add and mul swap, as do less_than and equals.
+     */
+    void patch() {
+        emit({1101, 0, 0, 0});
+        patches.push_back({words.size() - 2, words.size() - 1, 0});
+    }
+
+  public:
+    Generator(uint64_t seed) : rng(seed) {};
+
+    Case next() {
+        words.clear();
+        starts.clear();
+        labels.clear();
+        fixups.clear();
+        targets.clear();
+        patches.clear();
+
+        // Data lives right after the code, so stray writes hit both. Frames
+        // mostly start above it rather than on the code.
+        auto pieces = uniform(3, 30);
+        data = pieces * 18;
+        if (chance(0.9))
+            emit({109, data + SCRATCH + 32});
+        std::vector<std::size_t> functions{};
+        // Jumps only enter pieces at the top, so they cannot skip a loop's
+        // initialization and leave it running forever.
+        std::vector<code> entries{};
+        for (code i = 0; i < pieces; i++) {
+            entries.push_back(words.size());
+            auto kind = uniform(0, 20);
+            if (kind < 12)
+                random_instruction();
+            else if (kind < 15)
+                counted_loop();
+            else if (kind < 17)
+                call(functions);
+            else if (kind < 18)
+                repeated_call(functions);
+            else
+                patch();
+        }
+        // The halt is also a target, so every jump has one ahead of it.
+        entries.push_back(words.size());
+        emit({99});
+        for (auto f : functions)
+            function_body(f);
+
+        for (auto [l, after] : targets) {
+            auto first = std::lower_bound(entries.begin(), entries.end(), after);
+            if (chance(0.05))
+                first = entries.begin();
+            labels[l] = first[uniform(0, entries.end() - first - 1)];
+        }
+        for (auto [at, l] : fixups)
+            words[at] = labels[l];
+        for (auto [value, address, _] : patches) {
+            std::vector<code> patchable{};
+            for (auto s : starts)
+                if (auto op = words[s] % 100; op == 1 || op == 2 || op == 7 || op == 8)
+                    patchable.push_back(s);
+            auto target = patchable[uniform(0, patchable.size() - 1)];
+            static const code swapped[] = {0, 2, 1, 0, 0, 0, 0, 8, 7};
+            words[value] = words[target] - words[target] % 100 + swapped[words[target] % 100];
+            words[address] = target;
+        }
+        words.resize(std::max<std::size_t>(words.size(), data + 1));
+
+        Case c{words, {}};
+        for (auto n = uniform(0, 8); n > 0; n--)
+            c.input.push_back(uniform(-20, 100));
+        return c;
+    }
+};
+
+const int ENGINE_TIMEOUT_MS = 2000;
+
+/**
+ * Runs `args` in `cwd` with stdin, stdout and stderr redirected to files,
+ * killed by SIGALRM after ENGINE_TIMEOUT_MS. Returns the wait status.
+ */
+int spawn(const std::vector<std::string> &args, const std::string &cwd, const std::string &in, const std::string &out, const std::string &err) {
+    auto pid = fork();
+    if (pid < 0)
+        throw std::system_error(errno, std::generic_category(), "fork");
+    if (pid == 0) {
+        auto redirect = [](const std::string &path, int fd, int flags) {
+            auto f = open(path.c_str(), flags, 0644);
+            if (f < 0 || dup2(f, fd) < 0)
+                _exit(127);
+            close(f);
+        };
+        if (chdir(cwd.c_str()) != 0)
+            _exit(127);
+        redirect(in, STDIN_FILENO, O_RDONLY);
+        redirect(out, STDOUT_FILENO, O_WRONLY | O_CREAT | O_TRUNC);
+        redirect(err, STDERR_FILENO, O_WRONLY | O_CREAT | O_TRUNC);
+        // Interval timers survive exec.
+        itimerval timer{{0, 0}, {ENGINE_TIMEOUT_MS / 1000, (ENGINE_TIMEOUT_MS % 1000) * 1000}};
+        setitimer(ITIMER_REAL, &timer, nullptr);
+        std::vector<char *> argv{};
+        for (auto &a : args)
+            argv.push_back(const_cast<char *>(a.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            throw std::system_error(errno, std::generic_category(), "waitpid");
+    return status;
+}
+
+std::string slurp(const std::string &path) {
+    std::ifstream file(path);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+void write_case(const Case &c, const std::string &program_path, const std::string &input_path) {
+    std::ofstream program(program_path, std::ios::trunc);
+    for (std::size_t i = 0; i < c.program.size(); i++)
+        program << (i ? "," : "") << c.program[i];
+    std::ofstream input(input_path, std::ios::trunc);
+    for (auto x : c.input)
+        input << x << '\n';
+}
+
+std::string join(const std::vector<code> &values) {
+    std::string s{};
+    for (std::size_t i = 0; i < values.size(); i++)
+        s += std::format("{}{}", i ? "," : "", values[i]);
+    return s;
+}
+
+/**
+ * The first difference between how `expected` and `actual` ended and what they
+ * output, if any.
+ */
+std::optional<std::string> compare_output(const Outcome &expected, const Outcome &actual) {
+    if (expected.end != actual.end)
+        return std::format("ended with {}, expected {}", end_name(actual.end), end_name(expected.end));
+    for (std::size_t i = 0; i < std::max(expected.output.size(), actual.output.size()); i++) {
+        if (i >= actual.output.size())
+            return std::format("stopped after {} outputs, expected {}", i, expected.output.size());
+        if (i >= expected.output.size())
+            return std::format("output {} is an extra {}", i, actual.output[i]);
+        if (expected.output[i] != actual.output[i])
+            return std::format("output {} is {}, expected {}", i, actual.output[i], expected.output[i]);
+    }
+    return std::nullopt;
+}
+
+/**
+ * As compare_output, then the first difference in the machine state.
+ */
+std::optional<std::string> compare(const Outcome &expected, const Outcome &actual) {
+    if (auto difference = compare_output(expected, actual))
+        return difference;
+    std::istringstream e(expected.state), a(actual.state);
+    for (std::string el, al;;) {
+        auto more_e = static_cast<bool>(std::getline(e, el)), more_a = static_cast<bool>(std::getline(a, al));
+        if (!more_e && !more_a)
+            return std::nullopt;
+        if (el != al || more_e != more_a)
+            return std::format("state has \"{}\", expected \"{}\"", more_a ? al : "<end>", more_e ? el : "<end>");
+    }
+}
+
+/**
+ * An engine under test. `check` runs a case and returns how it diverged from
+ * the reference, or nullopt if it agreed or the case is out of its reach.
+ * Engines that can stop after a number of instructions also have `run_steps`,
+ * which runs a case that far, so that a divergence can be pinned to the
+ * instruction where it starts (see pin).
+ */
+struct Engine {
+    std::string name;
+    std::function<std::optional<std::string>(const Case &, const Outcome &, const std::string &, Engine &)> check;
+    std::function<Outcome(const Case &, uint64_t, const std::string &)> run_steps{};
+    uint64_t runs = 0;
+    uint64_t diverged = 0;
+};
+
+/**
+ * How a process that did not exit with 0 ended, for tools that report a
+ * failure as a message and status 1.
+ */
+End exit_end(int status, const std::string &messages) {
+    if (WIFSIGNALED(status))
+        return WTERMSIG(status) == SIGALRM ? End::timeout : End::crashed;
+    if (WEXITSTATUS(status) != 1)
+        return End::crashed;
+    return messages.find("memory fault") != std::string::npos ? End::fault : End::invalid;
+}
+
+/**
+ * Reads back what `runner ... --dump-memory` left behind.
+ */
+Outcome runner_outcome(int status, const std::string &out, const std::string &err, const std::string &dump) {
+    Outcome outcome{End::halted, {}, {}};
+    std::istringstream values(slurp(out));
+    for (code x; values >> x;)
+        outcome.output.push_back(x);
+    auto messages = slurp(err);
+    if (WIFEXITED(status) && WEXITSTATUS(status) <= 1)
+        outcome.state = slurp(dump);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        outcome.end = exit_end(status, messages);
+    } else if (auto at = messages.find("stopped after "); at != std::string::npos) {
+        outcome.end = End::timeout;
+        outcome.steps = std::stoull(messages.substr(at + std::string_view("stopped after ").size()));
+    } else {
+        outcome.end = outcome.state.find("\nhalted 1\n") != std::string::npos ? End::halted : End::blocked;
+    }
+    return outcome;
+}
+
+/**
+ * bin/runner with `flags`. With `train`, a run with --profile-out comes first
+ * and the checked run is laid out by its profile.
+ */
+Engine runner_engine(std::string name, std::string binary, std::vector<std::string> flags, bool train) {
+    auto run = [name, binary, flags, train](const Case &c, std::optional<uint64_t> steps, const std::string &dir) {
+        auto program = dir + "/case.ic", input = dir + "/case.in";
+        auto out = dir + "/" + name + ".out", err = dir + "/" + name + ".err", dump = dir + "/" + name + ".dump";
+        write_case(c, program, input);
+        if (train) {
+            auto training = spawn({binary, "--profile-out", dir + "/train.prof", program}, dir, input, out, err);
+            if (!WIFEXITED(training) || WEXITSTATUS(training) > 1)
+                return Outcome{End::crashed, {}, {}};
+        }
+        std::vector<std::string> args{binary};
+        args.insert(args.end(), flags.begin(), flags.end());
+        if (steps)
+            args.insert(args.end(), {"--steps", std::to_string(*steps)});
+        args.insert(args.end(), {"--dump-memory", dump, program});
+        std::remove(dump.c_str());
+        return runner_outcome(spawn(args, dir, input, out, err), out, err, dump);
+    };
+    auto check = [run](const Case &c, const Outcome &expected, const std::string &dir, Engine &self) {
+        self.runs++;
+        return compare(expected, run(c, std::nullopt, dir));
+    };
+    return Engine{std::move(name), check, run};
+}
+
+/**
+ * bin/day09 --accelerate. It runs the program from inputs/day09.txt with
+ * input 1 and then 2 and prints only each run's first output, so it is
+ * checked only on cases where both runs end normally with some output.
+ */
+Engine day09_engine(std::string binary) {
+    auto check = [binary](const Case &c, const Outcome &, const std::string &dir, Engine &self) -> std::optional<std::string> {
+        std::string expected{};
+        for (code id : {1, 2}) {
+            auto outcome = reference(Case{c.program, {id}});
+            if ((outcome.end != End::halted && outcome.end != End::blocked) || outcome.output.empty())
+                return std::nullopt;
+            expected += std::format("Part 1: {}\n", outcome.output[0]);
+        }
+        auto root = dir + "/day09";
+        std::filesystem::create_directories(root + "/inputs");
+        write_case(Case{c.program, {}}, root + "/inputs/day09.txt", root + "/none.in");
+        auto status = spawn({binary, "--accelerate"}, root, root + "/none.in", root + "/day09.out", "/dev/null");
+        self.runs++;
+        auto actual = slurp(root + "/day09.out");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return std::format("exited with status {}", status);
+        if (actual != expected)
+            return std::format("printed \"{}\", expected \"{}\"", actual, expected);
+        return std::nullopt;
+    };
+    return Engine{"day09-accelerate", check};
+}
+
+/**
+ * The line `batch` should print for one input vector: `values` are the
+ * inputs, or with `patch` the words to write there first, and with `peek` the
+ * word at that address after the run is printed instead of the outputs.
+ * nullopt if the run goes past the budget.
+ */
+std::optional<std::string> batch_line(const std::vector<code> &program, const std::vector<code> &values, const std::vector<code> &patch, std::optional<code> peek) {
+    Computer computer{Program(program)};
+    std::deque<code> input{};
+    std::vector<code> output{};
+    try {
+        if (patch.empty())
+            input.assign(values.begin(), values.end());
+        for (std::size_t i = 0; i < patch.size(); i++)
+            computer.poke(patch[i], values[i]);
+        auto end = computer.run(input, output, BUDGET);
+        if (end == End::timeout)
+            return std::nullopt;
+        std::string line{};
+        if (peek) {
+            line = std::to_string(computer.peek(*peek));
+        } else {
+            line = join(output);
+        }
+        return end == End::blocked ? line + " (awaiting input)" : line;
+    } catch (std::exception &e) {
+        return std::format("error: {}", e.what());
+    }
+}
+
+/**
+ * bin/batch on one thread, so the computer is reset between lines. A case
+ * becomes three lines: its inputs, the inputs with the first one bumped, and
+ * the inputs again. One case in three patches the inputs into addresses 1 and
+ * 2 instead, and one in three peeks at a word after the run; both sometimes
+ * pick a negative address, which must come back as a memory fault on that
+ * line rather than take the process down.
+ */
+Engine batch_engine(std::string binary) {
+    auto check = [binary](const Case &c, const Outcome &, const std::string &dir, Engine &self) -> std::optional<std::string> {
+        // Program sizes all fall on the same residues, so pick by content.
+        uint64_t hash = 0;
+        for (auto word : c.program)
+            hash = hash * 31 + static_cast<uint64_t>(word);
+        auto mode = hash % 3;
+        auto negative = -1 - static_cast<code>(hash / 3 % 4);
+        auto odd = hash / 12 % 2 == 1;
+        std::vector<code> patch{};
+        std::optional<code> peek{};
+        std::vector<std::string> args{binary, "--threads", "1"};
+        if (mode == 1) {
+            patch = {1, odd ? negative : 2};
+            args.insert(args.end(), {"--patch", join(patch)});
+        } else if (mode == 2) {
+            peek = odd ? negative : static_cast<code>(c.program.size() / 2);
+            args.insert(args.end(), {"--peek", std::to_string(*peek)});
+        }
+        auto first = c.input;
+        if (!patch.empty())
+            first.resize(patch.size());
+        auto bumped = first;
+        if (!bumped.empty())
+            bumped[0]++;
+
+        std::string lines{}, expected{};
+        for (auto *values : {&first, &bumped, &first}) {
+            auto line = batch_line(c.program, *values, patch, peek);
+            if (!line)
+                return std::nullopt;
+            lines += join(*values) + '\n';
+            expected += *line + '\n';
+        }
+        auto program = dir + "/case.ic", input = dir + "/batch.in", out = dir + "/batch.out";
+        write_case(Case{c.program, {}}, program, dir + "/none.in");
+        std::ofstream(input, std::ios::trunc) << lines;
+        args.push_back(program);
+        auto status = spawn(args, dir, input, out, "/dev/null");
+        self.runs++;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return std::format("exited with status {}", status);
+        auto actual = slurp(out);
+        if (actual != expected)
+            return std::format("printed \"{}\", expected \"{}\"", actual, expected);
+        return std::nullopt;
+    };
+    return Engine{"batch", check};
+}
+
+/**
+ * Output values, one per line or separated by `separator`.
+ */
+std::vector<code> read_values(std::string text, char separator = '\n') {
+    std::replace(text.begin(), text.end(), separator, ' ');
+    std::vector<code> values{};
+    std::istringstream stream(text);
+    for (code x; stream >> x;)
+        values.push_back(x);
+    return values;
+}
+
+/**
+ * bin/day05 --input, which queues all the inputs up front and fails when the
+ * program wants more.
+ */
+Engine day05_engine(std::string binary) {
+    auto check = [binary](const Case &c, const Outcome &expected, const std::string &dir, Engine &self) -> std::optional<std::string> {
+        auto program = dir + "/case.ic", out = dir + "/day05.out", err = dir + "/day05.err";
+        write_case(Case{c.program, {}}, program, dir + "/none.in");
+        auto status = spawn({binary, "--input", join(c.input), program}, dir, dir + "/none.in", out, err);
+        self.runs++;
+        Outcome actual{End::halted, {}, {}};
+        auto messages = slurp(err);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            actual.output = read_values(slurp(out), ',');
+        else if (WIFEXITED(status) && WEXITSTATUS(status) == 1 && messages.find("needs more") != std::string::npos)
+            actual.end = End::blocked;
+        else
+            actual.end = exit_end(status, messages);
+        // Nothing is printed unless the program halts.
+        auto wanted = expected;
+        if (wanted.end != End::halted)
+            wanted.output.clear();
+        return compare_output(wanted, actual);
+    };
+    return Engine{"day05", check};
+}
+
+/**
+ * bin/scheduler with a slice of 7 instructions, so that a case is cut into
+ * many slices that mostly end inside a loop or a call. Its instruction count,
+ * kept across slices, has to match the reference's.
+ */
+Engine scheduler_engine(std::string binary) {
+    auto check = [binary](const Case &c, const Outcome &expected, const std::string &dir, Engine &self) -> std::optional<std::string> {
+        auto program = dir + "/case.ic", input = dir + "/scheduler.in", out = dir + "/scheduler.out", err = dir + "/scheduler.err";
+        write_case(Case{c.program, {}}, program, dir + "/none.in");
+        std::ofstream pairs(input, std::ios::trunc);
+        for (auto x : c.input)
+            pairs << "0 " << x << '\n';
+        pairs.close();
+        auto status = spawn({binary, "--slice", "7", program}, dir, input, out, err);
+        self.runs++;
+        Outcome actual{End::halted, {}, {}};
+        std::istringstream values(slurp(out));
+        for (code vm, x; values >> vm >> x;)
+            actual.output.push_back(x);
+        auto messages = slurp(err);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            actual.end = exit_end(status, messages);
+            return compare_output(expected, actual);
+        }
+        std::istringstream report(messages);
+        std::string vm, count, instructions, state;
+        report >> vm >> vm >> count >> instructions >> state;
+        actual.end = state == "halted," ? End::halted : End::blocked;
+        if (auto difference = compare_output(expected, actual))
+            return difference;
+        if (count != std::to_string(expected.steps))
+            return std::format("executed {} instructions, expected {}", count, expected.steps);
+        return std::nullopt;
+    };
+    return Engine{"scheduler", check};
+}
+
+/**
+ * bin/fleet running the case as its only computer, in one worker process,
+ * with the inputs fed through its ring and the outputs drained from the next.
+ */
+Engine fleet_engine(std::string binary) {
+    auto check = [binary](const Case &c, const Outcome &expected, const std::string &dir, Engine &self) -> std::optional<std::string> {
+        auto program = dir + "/case.ic", input = dir + "/case.in", out = dir + "/fleet.out", err = dir + "/fleet.err";
+        write_case(c, program, input);
+        auto status = spawn({binary, "--procs", "1", program}, dir, input, out, err);
+        self.runs++;
+        Outcome actual{End::halted, {}, {}};
+        actual.output = read_values(slurp(out));
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            actual.end = exit_end(status, slurp(err));
+        // A computer that waits on its closed input ring just stops.
+        auto wanted = expected;
+        if (wanted.end == End::blocked)
+            wanted.end = End::halted;
+        return compare_output(wanted, actual);
+    };
+    return Engine{"fleet", check};
+}
+
+/**
+ * bin/bench --runs 1, which runs the case on its switch and decode-table
+ * engines and fails unless they agree on the outputs and the instruction
+ * count. Only the count is printed, for each engine, and has to match the
+ * reference's.
+ */
+Engine bench_engine(std::string binary) {
+    auto check = [binary](const Case &c, const Outcome &expected, const std::string &dir, Engine &self) -> std::optional<std::string> {
+        auto program = dir + "/case.ic", out = dir + "/bench.out", err = dir + "/bench.err";
+        write_case(Case{c.program, {}}, program, dir + "/none.in");
+        std::vector<std::string> args{binary, "--runs", "1", program};
+        for (auto x : c.input)
+            args.push_back(std::to_string(x));
+        auto status = spawn(args, dir, dir + "/none.in", out, err);
+        self.runs++;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            Outcome actual{exit_end(status, slurp(err)), {}, {}};
+            if (actual.end != expected.end)
+                return std::format("ended with {}, expected {}: {}", end_name(actual.end), end_name(expected.end), slurp(err));
+            return std::nullopt;
+        }
+        if (expected.end != End::halted && expected.end != End::blocked)
+            return std::format("ended normally, expected {}", end_name(expected.end));
+        std::istringstream table(slurp(out));
+        std::string line{};
+        std::getline(table, line);
+        for (std::string name; table >> name && name != "peak";) {
+            std::string count{};
+            table >> count;
+            std::getline(table, line);
+            if (count != std::to_string(expected.steps))
+                return std::format("{} executed {} instructions, expected {}", name, count, expected.steps);
+        }
+        return std::nullopt;
+    };
+    return Engine{"bench", check};
+}
+
+/**
+ * Finds the first instruction after which `engine` no longer agrees with the
+ * reference, by bisecting on how many instructions both run: the state and
+ * outputs after 0 instructions agree, those at the end do not. This assumes
+ * that a difference, once there, stays. An engine may stop later than asked,
+ * e.g. after a memoized call, and then says where; the reference is compared
+ * at that point. Returns the instruction, or nullopt if the engine cannot stop
+ * early or the divergence does not show that way.
+ */
+std::optional<std::string> pin(const Case &c, Engine &engine, const std::string &dir) {
+    if (!engine.run_steps)
+        return std::nullopt;
+    auto differs = [&](uint64_t steps) {
+        auto actual = engine.run_steps(c, steps, dir);
+        return compare(reference(c, actual.end == End::timeout ? actual.steps : steps), actual).has_value();
+    };
+    uint64_t agrees = 0, diverges = reference(c).steps + 1;
+    if (differs(agrees) || !differs(diverges))
+        return std::nullopt;
+    while (diverges - agrees > 1) {
+        auto middle = agrees + (diverges - agrees) / 2;
+        (differs(middle) ? diverges : agrees) = middle;
+    }
+
+    Computer computer{Program(c.program)};
+    std::deque<code> input(c.input.begin(), c.input.end());
+    std::vector<code> output{};
+    std::vector<code> words{};
+    try {
+        computer.run(input, output, agrees);
+        for (code i = 0; i < 4; i++)
+            words.push_back(computer.peek(computer.where() + i));
+    } catch (std::exception &) {
+        // Past the end of memory, or the reference had already stopped.
+    }
+    return std::format("instruction {} at pc {}: {}", diverges, computer.where(), join(words));
+}
+
+const std::size_t MINIMIZE_ATTEMPTS = 2000;
+
+/**
+ * Shrinks a case `engine` diverges on: delta-debugs the program words away in
+ * halving chunks, then zeroes single words, then drops inputs from the end,
+ * keeping each change that still diverges from the reference.
+ */
+Case minimize(Case c, Engine &engine, const std::string &dir) {
+    auto attempts = std::size_t{0};
+    auto fails = [&](const Case &candidate) {
+        attempts++;
+        auto expected = reference(candidate);
+        if (expected.end == End::timeout)
+            return false;
+        auto runs = engine.runs;
+        auto diverges = engine.check(candidate, expected, dir, engine).has_value();
+        engine.runs = runs;
+        return diverges;
+    };
+    for (auto chunk = c.program.size() / 2; chunk >= 1 && attempts < MINIMIZE_ATTEMPTS; chunk /= 2) {
+        for (std::size_t at = 0; at + chunk <= c.program.size() && attempts < MINIMIZE_ATTEMPTS;) {
+            auto candidate = c;
+            candidate.program.erase(candidate.program.begin() + at, candidate.program.begin() + at + chunk);
+            if (!candidate.program.empty() && fails(candidate))
+                c = std::move(candidate);
+            else
+                at += chunk;
+        }
+    }
+    for (std::size_t at = 0; at < c.program.size() && attempts < MINIMIZE_ATTEMPTS; at++) {
+        if (c.program[at] == 0)
+            continue;
+        auto candidate = c;
+        candidate.program[at] = 0;
+        if (fails(candidate))
+            c = std::move(candidate);
+    }
+    while (!c.input.empty() && attempts < MINIMIZE_ATTEMPTS) {
+        auto candidate = c;
+        candidate.input.pop_back();
+        if (!fails(candidate))
+            break;
+        c = std::move(candidate);
+    }
+    return c;
+}
+
+/**
+ * Usage: fuzz [--cases N] [--seed S] [--bin DIR]
+ *
+ * Generates N random programs, runs each on the reference interpreter and on
+ * every engine built in DIR (default bin), and compares outputs, how the run
+ * ended and, where the engine can dump it, the machine state at the end,
+ * including after a fault. The first divergence of each engine is minimized
+ * and printed, for the runner's engines together with the instruction it
+ * starts at. A table of runs and divergences per engine follows. Exits with 1
+ * if any engine diverged.
+ *
+ * The engines run as separate processes, so no time is reported for them; it
+ * would mostly be process start-up. Only the runner can dump its state and stop
+ * at a given instruction. The other tools are checked on what they print:
+ * their outputs, how the run ended and, for scheduler and bench, the
+ * instruction count.
+ */
+int main(int argc, char **argv) {
+    std::size_t cases = 200;
+    uint64_t seed = std::random_device{}();
+    std::string bin = "bin";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--cases" && i + 1 < argc) {
+            cases = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if (arg == "--bin" && i + 1 < argc) {
+            bin = argv[++i];
+        } else {
+            std::cerr << "usage: fuzz [--cases N] [--seed S] [--bin DIR]" << std::endl;
+            return 2;
+        }
+    }
+
+    auto runner = std::filesystem::absolute(bin + "/runner").string();
+    auto day09 = std::filesystem::absolute(bin + "/day09").string();
+    auto batch = std::filesystem::absolute(bin + "/batch").string();
+    auto day05 = std::filesystem::absolute(bin + "/day05").string();
+    auto scheduler = std::filesystem::absolute(bin + "/scheduler").string();
+    auto fleet = std::filesystem::absolute(bin + "/fleet").string();
+    auto bench = std::filesystem::absolute(bin + "/bench").string();
+    std::vector<Engine> engines{};
+    engines.push_back(runner_engine("runner", runner, {}, false));
+    engines.push_back(runner_engine("memoize", runner, {"--memoize"}, false));
+    engines.push_back(runner_engine("cache", runner, {"--profile-out", "/dev/null"}, false));
+    engines.push_back(runner_engine("layout", runner, {"--profile", "train.prof"}, true));
+    engines.push_back(day09_engine(day09));
+    engines.push_back(batch_engine(batch));
+    engines.push_back(day05_engine(day05));
+    engines.push_back(scheduler_engine(scheduler));
+    engines.push_back(fleet_engine(fleet));
+    engines.push_back(bench_engine(bench));
+    for (auto &path : {runner, day09, batch, day05, scheduler, fleet, bench}) {
+        if (access(path.c_str(), X_OK) != 0) {
+            std::cerr << std::format("{} is not built", path) << std::endl;
+            return 2;
+        }
+    }
+
+    char dir_template[] = "/tmp/fuzz.XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        std::cerr << "cannot create a scratch directory" << std::endl;
+        return 2;
+    }
+    std::string dir = dir_template;
+
+    std::cout << std::format("seed {}", seed) << std::endl;
+    Generator generator(seed);
+    std::size_t skipped = 0;
+    std::unordered_map<End, std::size_t> ends{};
+    for (std::size_t n = 0; n < cases; n++) {
+        auto c = generator.next();
+        auto expected = reference(c);
+        if (expected.end == End::timeout) {
+            skipped++;
+            continue;
+        }
+        ends[expected.end]++;
+        for (auto &engine : engines) {
+            auto divergence = engine.check(c, expected, dir, engine);
+            if (!divergence)
+                continue;
+            if (engine.diverged++ > 0)
+                continue;
+            auto small = minimize(c, engine, dir);
+            auto runs = engine.runs;
+            auto why = engine.check(small, reference(small), dir, engine);
+            auto where = pin(small, engine, dir);
+            engine.runs = runs;
+            std::cout << std::format("{} diverges on case {}: {}\n  program: {}\n  input: {}\n", engine.name, n, why.value_or(*divergence), join(small.program),
+                                     join(small.input));
+            if (where)
+                std::cout << std::format("  first wrong after {}\n", *where);
+        }
+    }
+    std::filesystem::remove_all(dir);
+
+    std::cout << std::format("{} cases, {} dropped for running past {} steps;", cases, skipped, BUDGET);
+    for (auto end : {End::halted, End::blocked, End::fault, End::invalid})
+        std::cout << std::format(" {} {}", ends[end], end_name(end));
+    std::cout << '\n';
+    std::cout << std::format("{:<18} {:>6} {:>9}\n", "engine", "runs", "diverged");
+    bool ok = true;
+    for (auto &engine : engines) {
+        ok = ok && engine.diverged == 0;
+        std::cout << std::format("{:<18} {:>6} {:>9}\n", engine.name, engine.runs, engine.diverged);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,1583 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum class Opcode {
+    add = 1,
+    mul = 2,
+    input = 3,
+    output = 4,
+    jump_true = 5,
+    jump_false = 6,
+    less_than = 7,
+    equals = 8,
+    relative_base = 9,
+    halt = 99,
+};
+
+enum class ParamMode {
+    position = 0,
+    immediate = 1,
+    relative = 2,
+};
+
+typedef long code;
+
+/**
+ * Raised when the program touches an address outside of its memory, i.e. not
+ * in [0, 2^31).
+ */
+class MemoryFault : public std::out_of_range {
+  public:
+    code address;
+    MemoryFault(code address) : std::out_of_range(std::format("memory fault at address {}", address)), address(address) {};
+};
+
+/**
+ * Memory is one anonymous mapping, zero-filled on demand by the kernel, that
+ * covers addresses [0, capacity). A write past it moves the mapping to a
+ * larger one with mremap, which carries the page tables over, so nothing is
+ * copied and untouched pages stay uncommitted. Reads and writes inside the
+ * mapping are plain loads and stores behind one unsigned compare, which also
+ * turns away negative addresses; reads past it are zeroes.
+ *
+ * This class is pasted verbatim into every tool that keeps Intcode memory in
+ * a mapping; keep the copies identical.
+ */
+class Program {
+  private:
+    // Smallest mapping, so that most programs never grow.
+    static constexpr std::size_t MIN_CAPACITY = std::size_t{1} << 16;
+    // Below this many bytes, clearing memory is cheaper than a madvise call.
+    static constexpr std::ptrdiff_t DISCARD_BYTES = 64 << 10;
+
+    code *memory = nullptr;
+    // Words mapped at `memory`, a power of two.
+    std::size_t capacity = 0;
+    // One past the highest address written, so copies know what to clone.
+    std::size_t extent = 0;
+
+    static std::size_t capacity_for(std::size_t words) {
+        return std::max(MIN_CAPACITY, std::bit_ceil(words));
+    }
+    [[gnu::cold]] code read_outside(code index) const {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        return 0;
+    }
+    [[gnu::cold]] void grow(code index) {
+        if (static_cast<uint64_t>(index) >= WORDS)
+            throw MemoryFault(index);
+        reserve(index + 1);
+    }
+
+  public:
+    // Addresses are [0, WORDS).
+    static constexpr std::size_t WORDS = std::size_t{1} << 31;
+
+    /**
+     * A program of `extent` zero words.
+     */
+    explicit Program(std::size_t extent) : capacity(capacity_for(extent)), extent(extent) {
+        auto region = mmap(nullptr, capacity * sizeof(code), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping intcode memory");
+        memory = static_cast<code *>(region);
+    }
+    Program(const std::vector<code> &image) : Program(image.size()) {
+        std::memcpy(memory, image.data(), image.size() * sizeof(code));
+    }
+    static Program parse(std::istream &input_stream) {
+        std::vector<code> program{};
+        for (std::string opcode_s; std::getline(input_stream, opcode_s, ',');) {
+            auto opcode = std::stol(opcode_s);
+            program.push_back(opcode);
+        }
+        return Program(program);
+    }
+    Program(const Program &other) : Program(other.extent) {
+        std::memcpy(memory, other.memory, extent * sizeof(code));
+    }
+    Program(Program &&other) noexcept : memory(other.memory), capacity(other.capacity), extent(other.extent) {
+        other.memory = nullptr;
+    }
+    Program &operator=(Program other) noexcept {
+        std::swap(memory, other.memory);
+        std::swap(capacity, other.capacity);
+        std::swap(extent, other.extent);
+        return *this;
+    }
+    ~Program() {
+        if (memory)
+            munmap(memory, capacity * sizeof(code));
+    }
+
+    code read(code index) const {
+        if (static_cast<uint64_t>(index) < capacity) [[likely]]
+            return memory[index];
+        return read_outside(index);
+    }
+    void write(code index, code value) {
+        if (static_cast<uint64_t>(index) >= capacity) [[unlikely]]
+            grow(index);
+        memory[index] = value;
+        extent = std::max(extent, static_cast<std::size_t>(index) + 1);
+    }
+
+    std::size_t size() const {
+        return extent;
+    }
+    code *data() {
+        return memory;
+    }
+    const code *data() const {
+        return memory;
+    }
+
+    /**
+     * Maps at least `words` words. Growing may move the mapping, which
+     * invalidates pointers from data().
+     */
+    void reserve(std::size_t words) {
+        if (words <= capacity)
+            return;
+        auto bigger = capacity_for(words);
+        auto region = mremap(memory, capacity * sizeof(code), bigger * sizeof(code), MREMAP_MAYMOVE);
+        if (region == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "growing intcode memory");
+        memory = static_cast<code *>(region);
+        capacity = bigger;
+    }
+
+    /**
+     * Makes this program's memory equal to `image` again without remapping:
+     * the image is copied back in and whatever was written past its end is
+     * cleared.
+     */
+    void reset(const Program &image) {
+        reserve(image.extent);
+        std::memcpy(memory, image.memory, image.extent * sizeof(code));
+        if (extent > image.extent)
+            clear(image.extent, extent);
+        extent = image.extent;
+    }
+
+    /**
+     * Zeroes words [from, to). Short ranges are overwritten; in longer ones
+     * the whole pages are handed back to the kernel, so the cost follows the
+     * pages actually touched rather than the range: a run that wrote one word
+     * at a high address leaves gigabytes below it that were never faulted in,
+     * and writing zeroes over them would commit them all.
+     */
+    void clear(std::size_t from, std::size_t to) {
+        static const auto page_bytes = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto begin = reinterpret_cast<char *>(memory + from);
+        auto end = reinterpret_cast<char *>(memory + to);
+        auto first = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(begin) + page_bytes - 1) & ~(page_bytes - 1));
+        auto last = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(end) & ~(page_bytes - 1));
+        if (last - first < DISCARD_BYTES) {
+            std::memset(begin, 0, end - begin);
+            return;
+        }
+        std::memset(begin, 0, first - begin);
+        std::memset(last, 0, end - last);
+        if (madvise(first, last - first, MADV_DONTNEED) != 0)
+            throw std::system_error(errno, std::generic_category(), "discarding intcode memory");
+    }
+};
+
+/**
+ * Indices of the pages below the extent of `p` holding anything but zeroes;
+ * the rest of memory is implied by zero-fill-on-demand.
+ */
+std::vector<uint64_t> touched_pages(const Program &p, std::size_t page_words) {
+    std::vector<uint64_t> pages{};
+    for (std::size_t page = 0; page * page_words < p.size(); page++) {
+        auto begin = p.data() + page * page_words;
+        if (std::any_of(begin, begin + page_words, [](code x) { return x != 0; }))
+            pages.push_back(page);
+    }
+    return pages;
+}
+
+/**
+ * Builds a program whose listed pages are private copy-on-write mappings of
+ * consecutive page-sized blocks of `fd` starting at `offset`, so nothing is
+ * read until the program touches it. mremap cannot move such a patchwork of
+ * mappings as one, so the program is given its whole address space up front
+ * and never has to grow.
+ */
+Program map_pages(int fd, off_t offset, const std::vector<uint64_t> &pages, std::size_t page_bytes, std::size_t extent) {
+    Program p(extent);
+    p.reserve(Program::WORDS);
+    for (std::size_t i = 0; i < pages.size();) {
+        // Coalesce runs of consecutive pages into one mapping.
+        auto run = std::size_t{1};
+        while (i + run < pages.size() && pages[i + run] == pages[i] + run)
+            run++;
+        auto address = reinterpret_cast<char *>(p.data()) + pages[i] * page_bytes;
+        auto mapped = mmap(address, run * page_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset + i * page_bytes);
+        if (mapped == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mapping snapshot pages");
+        i += run;
+    }
+    return p;
+}
+
+class Instruction {
+  public:
+    Opcode opcode;
+    ParamMode mode1;
+    ParamMode mode2;
+    ParamMode mode3;
+    static Instruction parse(code x) {
+        return Instruction(Opcode(x % 100), ParamMode((x / 100) % 10), ParamMode((x / 1000) % 10), ParamMode((x / 10000) % 10));
+    };
+};
+
+enum class Stop { halted, needs_input, output_full, step_limit };
+
+/**
+ * A memory cell a call read before writing it, or wrote: its address, relative
+ * to the caller's relative base when the call reached it in relative mode and
+ * absolute when in position mode, and the value it held.
+ */
+struct Cell {
+    code address;
+    bool relative;
+    code value;
+};
+
+/**
+ * The outcome of one pure call: whenever memory holds `reads`, running it again
+ * performs `writes`, moves the relative base by `rb_delta` and takes `steps`
+ * instructions.
+ */
+struct CallResult {
+    std::vector<Cell> reads;
+    std::vector<Cell> writes;
+    code rb_delta;
+    uint64_t steps;
+};
+
+struct CallSite {
+    // Set once a call from here did I/O, wrote below its caller's frame or
+    // reached one cell in both relative and position mode.
+    bool impure = false;
+    // The read addresses of the first recorded call. Results are bucketed by
+    // a hash of the values at these addresses and then checked in full, so a
+    // call whose footprint varies is still looked up correctly.
+    std::optional<std::vector<std::pair<code, bool>>> signature{};
+    std::unordered_map<uint64_t, std::vector<CallResult>> results{};
+};
+
+/**
+ * A call in progress: entered at the `rb += n; jump F` pair at `site`, done
+ * when control comes back to `return_pc`, just past the jump. Cells are kept
+ * by absolute address, with the mode they were reached in.
+ */
+struct Frame {
+    code site;
+    code rb0;
+    code return_pc;
+    uint64_t start;
+    // Whether each cell touched so far was reached in relative mode.
+    std::unordered_map<code, bool> modes{};
+    bool mixed_modes = false;
+    std::unordered_map<code, code> written{};
+    std::vector<Cell> reads{};
+
+    /**
+     * Records an access to `address`, and returns whether it is the first.
+     */
+    bool touch(code address, bool relative) {
+        auto [it, first] = modes.try_emplace(address, relative);
+        mixed_modes |= it->second != relative;
+        return first;
+    }
+};
+
+/**
+ * Memoizes calls under the relative-base calling convention. A call may read
+ * anything, but may only write at or above its caller's relative base (its
+ * stack frame and return slot) and may not do I/O; calls that break either
+ * rule mark their site impure. Every word fetched as code inside a call is
+ * remembered and the whole cache is dropped if one is ever overwritten.
+ */
+class CallMemo {
+  public:
+    std::unordered_map<code, CallSite> sites{};
+    std::vector<Frame> frames{};
+    std::vector<bool> code_words{};
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t flushes = 0;
+
+    void mark_code(code address) {
+        if (address < 0)
+            return;
+        if (static_cast<std::size_t>(address) >= code_words.size())
+            code_words.resize(address + 1);
+        code_words[address] = true;
+    }
+    void on_load(code address, code value, bool relative) {
+        if (frames.empty())
+            return;
+        auto &f = frames.back();
+        if (f.touch(address, relative))
+            f.reads.push_back({address, relative, value});
+    }
+    void on_store(code address, code value, bool relative) {
+        if (address >= 0 && static_cast<std::size_t>(address) < code_words.size() && code_words[address]) {
+            flush();
+            return;
+        }
+        if (frames.empty())
+            return;
+        auto &f = frames.back();
+        if (address < f.rb0) {
+            sites[f.site].impure = true;
+            frames.clear();
+            return;
+        }
+        f.touch(address, relative);
+        f.written[address] = value;
+    }
+    /**
+     * I/O inside a call: none of the calls in progress can be cached.
+     */
+    void abandon() {
+        for (auto &f : frames)
+            sites[f.site].impure = true;
+        frames.clear();
+    }
+    void flush() {
+        sites.clear();
+        frames.clear();
+        code_words.clear();
+        flushes++;
+    }
+
+    void enter(code site, code rb0, uint64_t executed) {
+        for (code a = site; a < site + 5; a++)
+            mark_code(a);
+        frames.push_back(Frame{site, rb0, site + 5, executed});
+    }
+    void leave(code rb, uint64_t executed) {
+        auto f = std::move(frames.back());
+        frames.pop_back();
+
+        // Relative cells move with the caller's relative base, absolute ones
+        // stay put; a cell reached both ways would be split in two.
+        auto cell = [&](code address, code value) {
+            auto relative = f.modes.at(address);
+            return Cell{relative ? address - f.rb0 : address, relative, value};
+        };
+        CallResult result{{}, {}, rb - f.rb0, executed - f.start};
+        for (auto &read : f.reads)
+            result.reads.push_back(cell(read.address, read.value));
+        for (auto [address, value] : f.written)
+            result.writes.push_back(cell(address, value));
+
+        auto &site = sites[f.site];
+        if (f.mixed_modes)
+            site.impure = true;
+        if (!site.impure) {
+            if (!site.signature) {
+                site.signature.emplace();
+                for (auto &cell : result.reads)
+                    site.signature->push_back({cell.address, cell.relative});
+            }
+            // Bucketed by the values the call saw on entry; a call that did not
+            // read every signature address can't be found again and is dropped.
+            auto key = hash(site, f.rb0, [&](code a) { return read_value(f, a); });
+            if (key)
+                site.results[*key].push_back(result);
+        }
+
+        // The enclosing call observed everything this one did.
+        for (auto &read : f.reads)
+            on_load(read.address, read.value, read.relative);
+        for (auto [address, value] : f.written) {
+            on_store(address, value, f.modes.at(address));
+            if (frames.empty())
+                break;
+        }
+    }
+
+    /**
+     * Hashes the values at the site's signature addresses, or returns nullopt
+     * if one of them cannot be read. `lookup` supplies values that differ from
+     * what is in memory now (a finished call's inputs, not its outputs).
+     */
+    template <typename Lookup> static std::optional<uint64_t> hash(const CallSite &site, code rb0, Lookup lookup) {
+        uint64_t h = 0xcbf29ce484222325;
+        for (auto [address, relative] : *site.signature) {
+            auto value = lookup(relative ? rb0 + address : address);
+            if (!value)
+                return std::nullopt;
+            h = (h ^ static_cast<uint64_t>(*value)) * 0x100000001b3;
+        }
+        return h;
+    }
+
+  private:
+    static std::optional<code> read_value(const Frame &f, code address) {
+        for (auto &read : f.reads)
+            if (read.address == address)
+                return read.value;
+        return std::nullopt;
+    }
+};
+
+/**
+ * An instruction decoded once. The operands are its raw parameters, and `next`
+ * (the instruction that follows it, or a jump not taken) and `target` (a jump
+ * taken to an immediate address) are indices into the decoded ops, so
+ * execution follows the layout rather than the address order. Either is
+ * NO_OP until it has been decoded; jumps through memory always look up
+ * their destination.
+ */
+struct DecodedOp {
+    Opcode opcode;
+    ParamMode mode1;
+    ParamMode mode2;
+    ParamMode mode3;
+    code pc;
+    code arg1;
+    code arg2;
+    code arg3;
+    uint32_t next;
+    uint32_t target;
+};
+
+const uint32_t NO_OP = UINT32_MAX;
+
+// Execution counts by the address of the instruction, from a training run.
+typedef std::unordered_map<code, uint64_t> Profile;
+
+/**
+ * Decoded code, laid out by a profile. Code is decoded in blocks that run to
+ * the next jump, halt or already decoded instruction. All blocks reachable
+ * from an entry point are decoded in one batch. Each batch is then ordered as
+ * chains: starting from the hottest block not yet placed, the hotter unplaced
+ * successor comes next, so hot paths are contiguous and mostly fall through.
+ * Blocks the profile never saw go last in address order. Without a profile
+ * this is plain address order.
+ *
+ * A store to any word of a decoded instruction drops the cache. Code is then
+ * decoded again from the current pc, so self-modifying programs keep working.
+ * Only addresses below CACHE_LIMIT are decoded. Code beyond that is left to
+ * the plain interpreter.
+ */
+class CodeCache {
+  public:
+    static constexpr code CACHE_LIMIT = code{1} << 24;
+
+    std::vector<DecodedOp> ops{};
+    // Per op, when training.
+    std::vector<uint64_t> counts{};
+    std::size_t block_count = 0;
+    uint64_t invalidations = 0;
+    code missed = 0;
+    const bool train;
+
+  private:
+    Profile profile;
+    // Counts of ops that were dropped by an invalidation.
+    Profile dropped{};
+    // The decoded index of each instruction start, NO_OP elsewhere.
+    std::vector<uint32_t> pc_map{};
+    // Set for every word of a decoded instruction.
+    std::vector<bool> code_cells{};
+
+    struct Block {
+        code leader;
+        std::vector<DecodedOp> ops;
+        std::vector<code> successors;
+        uint64_t weight;
+    };
+
+    static code width(Opcode opcode) {
+        switch (opcode) {
+            case Opcode::add:
+            case Opcode::mul:
+            case Opcode::less_than:
+            case Opcode::equals:
+                return 4;
+            case Opcode::jump_true:
+            case Opcode::jump_false:
+                return 3;
+            case Opcode::input:
+            case Opcode::output:
+            case Opcode::relative_base:
+                return 2;
+            default:
+                return 1;
+        }
+    }
+
+    /**
+     * Reads only the words the instruction uses, like the interpreter does, so
+     * decoding never touches memory that running the code would not.
+     */
+    static DecodedOp decode(const Program &p, code pc) {
+        auto in = Instruction::parse(p.read(pc));
+        auto n = width(in.opcode);
+        return DecodedOp{
+            in.opcode, in.mode1, in.mode2, in.mode3, pc, n > 1 ? p.read(pc + 1) : 0, n > 2 ? p.read(pc + 2) : 0, n > 3 ? p.read(pc + 3) : 0, NO_OP, NO_OP,
+        };
+    }
+    static bool is_decodable(code pc) {
+        return pc >= 0 && pc + 4 <= CACHE_LIMIT;
+    }
+    static bool is_jump(Opcode opcode) {
+        return opcode == Opcode::jump_true || opcode == Opcode::jump_false;
+    }
+
+    uint64_t weight(code pc) const {
+        auto it = profile.find(pc);
+        return it == profile.end() ? 0 : it->second;
+    }
+
+    std::vector<Block> decode_reachable(const Program &p, code entry) const {
+        std::vector<Block> blocks{};
+        std::unordered_set<code> decoded{};
+        std::vector<code> work{entry};
+        while (!work.empty()) {
+            auto leader = work.back();
+            work.pop_back();
+            if (!is_decodable(leader) || index_of(leader) != NO_OP || decoded.contains(leader))
+                continue;
+            Block block{leader, {}, {}, weight(leader)};
+            for (auto pc = leader;;) {
+                if (pc != leader && (index_of(pc) != NO_OP || decoded.contains(pc))) {
+                    block.successors.push_back(pc);
+                    break;
+                }
+                if (!is_decodable(pc))
+                    break;
+                auto op = decode(p, pc);
+                decoded.insert(pc);
+                block.ops.push_back(op);
+                if (is_jump(op.opcode)) {
+                    auto always = op.mode1 == ParamMode::immediate && (op.opcode == Opcode::jump_true) == (op.arg1 != 0);
+                    auto never = op.mode1 == ParamMode::immediate && !always;
+                    if (op.mode2 == ParamMode::immediate && !never)
+                        block.successors.push_back(op.arg2);
+                    if (!always)
+                        block.successors.push_back(pc + 3);
+                    break;
+                }
+                if (op.opcode == Opcode::halt || width(op.opcode) == 1)
+                    break;
+                pc += width(op.opcode);
+            }
+            for (auto s : block.successors)
+                work.push_back(s);
+            blocks.push_back(std::move(block));
+        }
+        return blocks;
+    }
+
+    std::vector<std::size_t> layout(const std::vector<Block> &blocks) const {
+        std::unordered_map<code, std::size_t> by_leader{};
+        for (std::size_t b = 0; b < blocks.size(); b++)
+            by_leader[blocks[b].leader] = b;
+        std::vector<std::size_t> hottest(blocks.size());
+        for (std::size_t b = 0; b < blocks.size(); b++)
+            hottest[b] = b;
+        std::sort(hottest.begin(), hottest.end(), [&](auto a, auto b) {
+            return std::pair(blocks[b].weight, blocks[a].leader) < std::pair(blocks[a].weight, blocks[b].leader);
+        });
+
+        std::vector<std::size_t> order{};
+        std::vector<bool> placed(blocks.size());
+        for (auto seed : hottest) {
+            if (placed[seed] || blocks[seed].weight == 0)
+                continue;
+            for (auto b = seed;;) {
+                placed[b] = true;
+                order.push_back(b);
+                std::optional<std::size_t> best{};
+                for (auto s : blocks[b].successors) {
+                    auto it = by_leader.find(s);
+                    if (it == by_leader.end() || placed[it->second] || blocks[it->second].weight == 0)
+                        continue;
+                    if (!best || blocks[it->second].weight > blocks[*best].weight)
+                        best = it->second;
+                }
+                if (!best)
+                    break;
+                b = *best;
+            }
+        }
+        std::vector<std::size_t> cold{};
+        for (std::size_t b = 0; b < blocks.size(); b++)
+            if (!placed[b])
+                cold.push_back(b);
+        std::sort(cold.begin(), cold.end(), [&](auto a, auto b) { return blocks[a].leader < blocks[b].leader; });
+        order.insert(order.end(), cold.begin(), cold.end());
+        return order;
+    }
+
+  public:
+    CodeCache(Profile profile, bool train) : train(train), profile(std::move(profile)) {};
+
+    uint32_t index_of(code pc) const {
+        return pc >= 0 && static_cast<std::size_t>(pc) < pc_map.size() ? pc_map[pc] : NO_OP;
+    }
+    bool is_code(code address) const {
+        return address >= 0 && static_cast<std::size_t>(address) < code_cells.size() && code_cells[address];
+    }
+
+    /**
+     * The op for the instruction at `pc`, decoding and laying out everything
+     * reachable from it first if needed. NO_OP if `pc` is outside the cache,
+     * with `pc` saved as `missed`.
+     */
+    uint32_t entry(const Program &p, code pc) {
+        if (auto i = index_of(pc); i != NO_OP)
+            return i;
+        if (!is_decodable(pc)) {
+            missed = pc;
+            return NO_OP;
+        }
+        auto blocks = decode_reachable(p, pc);
+        auto first = ops.size();
+        for (auto b : layout(blocks)) {
+            for (auto &op : blocks[b].ops) {
+                auto end = static_cast<std::size_t>(op.pc + width(op.opcode));
+                if (end > pc_map.size()) {
+                    pc_map.resize(end, NO_OP);
+                    code_cells.resize(end);
+                }
+                pc_map[op.pc] = ops.size();
+                std::fill(code_cells.begin() + op.pc, code_cells.begin() + end, true);
+                ops.push_back(op);
+            }
+        }
+        block_count += blocks.size();
+        for (auto i = first; i < ops.size(); i++) {
+            auto &op = ops[i];
+            if (op.opcode != Opcode::halt)
+                op.next = index_of(op.pc + width(op.opcode));
+            if (is_jump(op.opcode) && op.mode2 == ParamMode::immediate)
+                op.target = index_of(op.arg2);
+        }
+        if (train)
+            counts.resize(ops.size());
+        return index_of(pc);
+    }
+
+    /**
+     * Follows `next` (or `target` when `taken`, for a jump to an immediate
+     * address) out of op `i`, decoding the destination and linking it in on
+     * first use.
+     */
+    uint32_t follow(const Program &p, uint32_t i, bool taken) {
+        auto &link = taken ? ops[i].target : ops[i].next;
+        if (link != NO_OP)
+            return link;
+        auto j = entry(p, taken ? ops[i].arg2 : ops[i].pc + width(ops[i].opcode));
+        // entry may have grown `ops`, so `link` is not safe to use here.
+        (taken ? ops[i].target : ops[i].next) = j;
+        return j;
+    }
+
+    void invalidate() {
+        if (train)
+            for (std::size_t i = 0; i < ops.size(); i++)
+                dropped[ops[i].pc] += counts[i];
+        ops.clear();
+        counts.clear();
+        pc_map.clear();
+        code_cells.clear();
+        block_count = 0;
+        invalidations++;
+    }
+
+    /**
+     * The counts gathered so far, by address.
+     */
+    Profile collected() const {
+        auto result = dropped;
+        for (std::size_t i = 0; i < counts.size(); i++)
+            result[ops[i].pc] += counts[i];
+        return result;
+    }
+
+    static Profile read_profile(const std::string &path) {
+        std::ifstream file(path);
+        if (!file)
+            throw std::runtime_error(std::format("cannot open profile {}", path));
+        Profile result{};
+        code pc;
+        uint64_t count;
+        while (file >> pc >> count)
+            result[pc] += count;
+        if (!file.eof())
+            throw std::runtime_error(std::format("{} is not a profile", path));
+        return result;
+    }
+
+    /**
+     * One "pc count" line per executed instruction, in address order.
+     */
+    static void write_profile(const std::string &path, const Profile &profile) {
+        std::vector<std::pair<code, uint64_t>> lines(profile.begin(), profile.end());
+        std::sort(lines.begin(), lines.end());
+        std::ofstream file(path, std::ios::trunc);
+        for (auto [pc, count] : lines)
+            if (count > 0)
+                file << pc << ' ' << count << '\n';
+        if (!file.flush())
+            throw std::runtime_error(std::format("cannot write profile {}", path));
+    }
+};
+
+/**
+ * On-disk layout of a snapshot: this header, `page_count` uint64 page indices,
+ * `output_count` codes the program had already output, zero padding up to a
+ * page boundary, then the pages themselves in index order so they can be
+ * mapped straight from the file.
+ */
+struct SnapshotHeader {
+    char magic[8];
+    code pc;
+    code relative_base;
+    uint64_t halted;
+    uint64_t extent;
+    uint64_t page_bytes;
+    uint64_t page_count;
+    uint64_t output_count;
+};
+
+const std::string_view SNAPSHOT_MAGIC = "ICSNAP1";
+
+class Computer {
+  private:
+    Program p;
+    code pc = 0;
+    code relative_base = 0;
+    bool halted = false;
+    // Counted when memoizing or under a step limit.
+    uint64_t executed = 0;
+    uint64_t step_limit = UINT64_MAX;
+    std::unique_ptr<CallMemo> memo{};
+    std::unique_ptr<CodeCache> cache{};
+
+    template <bool memoize> code fetch(code address) {
+        if constexpr (memoize)
+            if (!memo->frames.empty())
+                memo->mark_code(address);
+        return p.read(address);
+    }
+    template <bool memoize> code load(code address, ParamMode mode) {
+        auto value = p.read(address);
+        if constexpr (memoize)
+            memo->on_load(address, value, mode == ParamMode::relative);
+        return value;
+    }
+    template <bool memoize> void store(code address, code value, ParamMode mode) {
+        if constexpr (memoize)
+            memo->on_store(address, value, mode == ParamMode::relative);
+        p.write(address, value);
+    }
+    template <bool memoize> code eval_read_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return load<memoize>(parameter, mode);
+            case ParamMode::immediate:
+                return parameter;
+            case ParamMode::relative:
+                return load<memoize>(relative_base + parameter, mode);
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+    code eval_write_operand(code parameter, ParamMode mode) {
+        switch (mode) {
+            case ParamMode::position:
+                return parameter;
+            case ParamMode::relative:
+                return relative_base + parameter;
+            case ParamMode::immediate:
+                throw std::invalid_argument("write operands cannot be in immediate mode");
+            default:
+                throw std::invalid_argument(std::format("{} is not a supported parameter mode", static_cast<int>(mode)));
+        }
+    }
+
+    /**
+     * Whether the instruction at `address` always jumps: jump_true on a nonzero
+     * immediate or jump_false on an immediate zero.
+     */
+    bool is_unconditional_jump(code address) {
+        auto in = Instruction::parse(p.read(address));
+        if (in.mode1 != ParamMode::immediate)
+            return false;
+        auto condition = p.read(address + 1);
+        return (in.opcode == Opcode::jump_true && condition != 0) || (in.opcode == Opcode::jump_false && condition == 0);
+    }
+
+    /**
+     * Whether one of `result`'s relative cells lands on one of its absolute
+     * cells when the caller's relative base is `rb0`. The recorded call kept
+     * them apart, so it says nothing about a call in which they are one cell.
+     */
+    static bool overlaps(const CallResult &result, code rb0) {
+        std::vector<code> absolute{};
+        for (auto cells : {&result.reads, &result.writes})
+            for (auto &cell : *cells)
+                if (!cell.relative)
+                    absolute.push_back(cell.address);
+        if (absolute.empty())
+            return false;
+        std::sort(absolute.begin(), absolute.end());
+        for (auto cells : {&result.reads, &result.writes})
+            for (auto &cell : *cells)
+                if (cell.relative && std::binary_search(absolute.begin(), absolute.end(), rb0 + cell.address))
+                    return true;
+        return false;
+    }
+
+    /**
+     * Replays a cached call from `site` if one matches the current memory.
+     */
+    bool replay_call(code site) {
+        auto it = memo->sites.find(site);
+        if (it == memo->sites.end() || it->second.impure || !it->second.signature)
+            return false;
+        auto rb0 = relative_base;
+        auto readable = [](code a) { return a >= 0 && a < (code{1} << 31); };
+        auto key = CallMemo::hash(it->second, rb0, [&](code a) { return readable(a) ? std::optional(p.read(a)) : std::nullopt; });
+        if (!key)
+            return false;
+        auto bucket = it->second.results.find(*key);
+        if (bucket == it->second.results.end())
+            return false;
+        auto locate = [&](const Cell &cell) { return cell.relative ? rb0 + cell.address : cell.address; };
+        auto mode = [](const Cell &cell) { return cell.relative ? ParamMode::relative : ParamMode::position; };
+        for (auto &result : bucket->second) {
+            auto matches = std::all_of(result.reads.begin(), result.reads.end(), [&](const Cell &cell) {
+                auto a = locate(cell);
+                return readable(a) && p.read(a) == cell.value;
+            });
+            if (!matches || overlaps(result, rb0))
+                continue;
+            // Copy: storing may flush the cache `result` lives in.
+            auto hit = result;
+            for (auto &cell : hit.reads)
+                memo->on_load(locate(cell), cell.value, cell.relative);
+            for (auto &cell : hit.writes)
+                store<true>(locate(cell), cell.value, mode(cell));
+            relative_base = rb0 + hit.rb_delta;
+            pc = site + 5;
+            executed += hit.steps;
+            memo->hits++;
+            return true;
+        }
+        return false;
+    }
+
+    template <bool memoize, bool limited> Stop run_loop(std::deque<code> &input, std::vector<code> &output, std::size_t output_limit) {
+        while (true) {
+            if constexpr (limited)
+                if (executed >= step_limit)
+                    return Stop::step_limit;
+            auto in = Instruction::parse(fetch<memoize>(pc));
+            if constexpr (memoize || limited)
+                executed++;
+
+            switch (in.opcode) {
+                case Opcode::halt: {
+                    if constexpr (memoize)
+                        memo->frames.clear();
+                    halted = true;
+                    return Stop::halted;
+                }
+                case Opcode::add: {
+                    auto arg1 = eval_read_operand<memoize>(fetch<memoize>(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand<memoize>(fetch<memoize>(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(fetch<memoize>(pc + 3), in.mode3);
+                    store<memoize>(arg3, arg1 + arg2, in.mode3);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::mul: {
+                    auto arg1 = eval_read_operand<memoize>(fetch<memoize>(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand<memoize>(fetch<memoize>(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(fetch<memoize>(pc + 3), in.mode3);
+                    store<memoize>(arg3, arg1 * arg2, in.mode3);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::input: {
+                    if (input.empty()) {
+                        if constexpr (memoize || limited)
+                            executed--;
+                        return Stop::needs_input;
+                    }
+                    if constexpr (memoize)
+                        memo->abandon();
+                    auto arg1 = eval_write_operand(fetch<memoize>(pc + 1), in.mode1);
+                    store<memoize>(arg1, input.front(), in.mode1);
+                    pc += 2;
+                    input.pop_front();
+                    break;
+                }
+                case Opcode::output: {
+                    if (output.size() >= output_limit) {
+                        if constexpr (memoize || limited)
+                            executed--;
+                        return Stop::output_full;
+                    }
+                    if constexpr (memoize)
+                        memo->abandon();
+                    auto arg1 = eval_read_operand<memoize>(fetch<memoize>(pc + 1), in.mode1);
+                    output.push_back(arg1);
+                    pc += 2;
+                    break;
+                }
+                case Opcode::jump_true: {
+                    auto arg1 = eval_read_operand<memoize>(fetch<memoize>(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand<memoize>(fetch<memoize>(pc + 2), in.mode2);
+                    pc = arg1 != 0 ? arg2 : pc + 3;
+                    if constexpr (memoize)
+                        if (!memo->frames.empty() && pc == memo->frames.back().return_pc)
+                            memo->leave(relative_base, executed);
+                    break;
+                }
+                case Opcode::jump_false: {
+                    auto arg1 = eval_read_operand<memoize>(fetch<memoize>(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand<memoize>(fetch<memoize>(pc + 2), in.mode2);
+                    pc = arg1 == 0 ? arg2 : pc + 3;
+                    if constexpr (memoize)
+                        if (!memo->frames.empty() && pc == memo->frames.back().return_pc)
+                            memo->leave(relative_base, executed);
+                    break;
+                }
+                case Opcode::less_than: {
+                    auto arg1 = eval_read_operand<memoize>(fetch<memoize>(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand<memoize>(fetch<memoize>(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(fetch<memoize>(pc + 3), in.mode3);
+                    store<memoize>(arg3, arg1 < arg2 ? 1 : 0, in.mode3);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::equals: {
+                    auto arg1 = eval_read_operand<memoize>(fetch<memoize>(pc + 1), in.mode1);
+                    auto arg2 = eval_read_operand<memoize>(fetch<memoize>(pc + 2), in.mode2);
+                    auto arg3 = eval_write_operand(fetch<memoize>(pc + 3), in.mode3);
+                    store<memoize>(arg3, arg1 == arg2 ? 1 : 0, in.mode3);
+                    pc += 4;
+                    break;
+                }
+                case Opcode::relative_base: {
+                    auto parameter = fetch<memoize>(pc + 1);
+                    auto arg1 = eval_read_operand<memoize>(parameter, in.mode1);
+                    if constexpr (memoize) {
+                        // `rb += n; jump F` opens a call frame.
+                        if (arg1 > 0 && is_unconditional_jump(pc + 2)) {
+                            executed--;
+                            if (replay_call(pc))
+                                break;
+                            memo->misses++;
+                            memo->enter(pc, relative_base, executed);
+                            executed++;
+                            // The frame size decides where the callee's frame
+                            // lies, so when read from memory it is one of the
+                            // call's inputs.
+                            if (in.mode1 != ParamMode::immediate)
+                                memo->on_load(in.mode1 == ParamMode::relative ? relative_base + parameter : parameter, arg1, in.mode1 == ParamMode::relative);
+                        }
+                    }
+                    relative_base += arg1;
+                    pc += 2;
+                    break;
+                }
+                default: {
+                    throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", pc, p.read(pc)));
+                }
+            }
+        }
+    }
+
+    /**
+     * Stores `value` for op `i` of the code cache and returns the op to run
+     * next. A store into decoded code drops the cache and decodes again from
+     * the instruction after op `i`, which is `width` words long.
+     */
+    uint32_t store_cached(uint32_t i, code address, code value, code width) {
+        p.write(address, value);
+        if (!cache->is_code(address))
+            return cache->follow(p, i, false);
+        auto after = cache->ops[i].pc + width;
+        cache->invalidate();
+        return cache->entry(p, after);
+    }
+
+    /**
+     * Executes from the code cache. Returns nullopt when control leaves the
+     * cached address range, with pc set for the plain interpreter to go on.
+     */
+    template <bool train, bool limited> std::optional<Stop> run_cached(std::deque<code> &input, std::vector<code> &output, std::size_t output_limit) {
+        auto i = cache->entry(p, pc);
+        // Ops only set pc on the way out, so a failing one has to as well.
+        try {
+            while (i != NO_OP) {
+                if constexpr (limited) {
+                    if (executed >= step_limit) {
+                        pc = cache->ops[i].pc;
+                        return Stop::step_limit;
+                    }
+                    executed++;
+                }
+                if constexpr (train)
+                    cache->counts[i]++;
+                auto &op = cache->ops[i];
+
+                switch (op.opcode) {
+                    case Opcode::halt: {
+                        pc = op.pc;
+                        halted = true;
+                        return Stop::halted;
+                    }
+                    case Opcode::add: {
+                        auto arg1 = eval_read_operand<false>(op.arg1, op.mode1);
+                        auto arg2 = eval_read_operand<false>(op.arg2, op.mode2);
+                        i = store_cached(i, eval_write_operand(op.arg3, op.mode3), arg1 + arg2, 4);
+                        break;
+                    }
+                    case Opcode::mul: {
+                        auto arg1 = eval_read_operand<false>(op.arg1, op.mode1);
+                        auto arg2 = eval_read_operand<false>(op.arg2, op.mode2);
+                        i = store_cached(i, eval_write_operand(op.arg3, op.mode3), arg1 * arg2, 4);
+                        break;
+                    }
+                    case Opcode::input: {
+                        if (input.empty()) {
+                            if constexpr (limited)
+                                executed--;
+                            pc = op.pc;
+                            return Stop::needs_input;
+                        }
+                        auto value = input.front();
+                        input.pop_front();
+                        i = store_cached(i, eval_write_operand(op.arg1, op.mode1), value, 2);
+                        break;
+                    }
+                    case Opcode::output: {
+                        if (output.size() >= output_limit) {
+                            if constexpr (limited)
+                                executed--;
+                            pc = op.pc;
+                            return Stop::output_full;
+                        }
+                        output.push_back(eval_read_operand<false>(op.arg1, op.mode1));
+                        i = cache->follow(p, i, false);
+                        break;
+                    }
+                    case Opcode::jump_true:
+                    case Opcode::jump_false: {
+                        auto arg1 = eval_read_operand<false>(op.arg1, op.mode1);
+                        auto arg2 = eval_read_operand<false>(op.arg2, op.mode2);
+                        if ((arg1 != 0) != (op.opcode == Opcode::jump_true))
+                            i = cache->follow(p, i, false);
+                        else if (op.mode2 == ParamMode::immediate)
+                            i = cache->follow(p, i, true);
+                        else
+                            i = cache->entry(p, arg2);
+                        break;
+                    }
+                    case Opcode::less_than: {
+                        auto arg1 = eval_read_operand<false>(op.arg1, op.mode1);
+                        auto arg2 = eval_read_operand<false>(op.arg2, op.mode2);
+                        i = store_cached(i, eval_write_operand(op.arg3, op.mode3), arg1 < arg2 ? 1 : 0, 4);
+                        break;
+                    }
+                    case Opcode::equals: {
+                        auto arg1 = eval_read_operand<false>(op.arg1, op.mode1);
+                        auto arg2 = eval_read_operand<false>(op.arg2, op.mode2);
+                        i = store_cached(i, eval_write_operand(op.arg3, op.mode3), arg1 == arg2 ? 1 : 0, 4);
+                        break;
+                    }
+                    case Opcode::relative_base: {
+                        relative_base += eval_read_operand<false>(op.arg1, op.mode1);
+                        i = cache->follow(p, i, false);
+                        break;
+                    }
+                    default: {
+                        throw std::invalid_argument(std::format("memory[{}]={} is not a supported opcode", op.pc, p.read(op.pc)));
+                    }
+                }
+            }
+        } catch (...) {
+            pc = cache->ops[i].pc;
+            throw;
+        }
+        pc = cache->missed;
+        return std::nullopt;
+    }
+
+    Computer(Program p, code pc, code relative_base, bool halted) : p(std::move(p)), pc(pc), relative_base(relative_base), halted(halted) {};
+
+  public:
+    Computer(Program p) : p(std::move(p)) {};
+
+    /**
+     * Writes pc, relative base, halted and every non-zero page of memory to
+     * `path`, along with `pending`, outputs produced so far that a restored run
+     * must still emit.
+     */
+    void save(const std::string &path, const std::vector<code> &pending) const {
+        std::size_t page_bytes = sysconf(_SC_PAGESIZE);
+        auto page_words = page_bytes / sizeof(code);
+        auto pages = touched_pages(p, page_words);
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC.data(), SNAPSHOT_MAGIC.size());
+        header.pc = pc;
+        header.relative_base = relative_base;
+        header.halted = halted;
+        header.extent = p.size();
+        header.page_bytes = page_bytes;
+        header.page_count = pages.size();
+        header.output_count = pending.size();
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(pages.data()), pages.size() * sizeof(uint64_t));
+        file.write(reinterpret_cast<const char *>(pending.data()), pending.size() * sizeof(code));
+        std::size_t written = sizeof(header) + pages.size() * sizeof(uint64_t) + pending.size() * sizeof(code);
+        std::vector<char> padding((page_bytes - written % page_bytes) % page_bytes);
+        file.write(padding.data(), padding.size());
+        for (auto page : pages)
+            file.write(reinterpret_cast<const char *>(p.data() + page * page_words), page_bytes);
+        if (!file.flush())
+            throw std::runtime_error(std::format("cannot write snapshot {}", path));
+    }
+
+    /**
+     * Restores a computer saved by `save`. Memory pages are mapped from the
+     * file copy-on-write rather than read, so start-up cost does not grow with
+     * the size of the image. Returns the computer and its pending outputs.
+     */
+    static std::tuple<Computer, std::vector<code>> restore(const std::string &path) {
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), std::format("opening snapshot {}", path));
+        struct Closer {
+            int fd;
+            ~Closer() {
+                close(fd);
+            }
+        } closer{fd};
+
+        SnapshotHeader header;
+        auto read_exact = [&](void *buffer, std::size_t size) {
+            if (::read(fd, buffer, size) != static_cast<ssize_t>(size))
+                throw std::runtime_error(std::format("{} is truncated", path));
+        };
+        read_exact(&header, sizeof(header));
+        if (std::string_view(header.magic, SNAPSHOT_MAGIC.size()) != SNAPSHOT_MAGIC || header.page_bytes != static_cast<uint64_t>(sysconf(_SC_PAGESIZE)))
+            throw std::runtime_error(std::format("{} is not a snapshot for this machine", path));
+        std::vector<uint64_t> pages(header.page_count);
+        std::vector<code> pending(header.output_count);
+        read_exact(pages.data(), pages.size() * sizeof(uint64_t));
+        read_exact(pending.data(), pending.size() * sizeof(code));
+
+        std::size_t offset = sizeof(header) + pages.size() * sizeof(uint64_t) + pending.size() * sizeof(code);
+        offset += (header.page_bytes - offset % header.page_bytes) % header.page_bytes;
+        auto program = map_pages(fd, offset, pages, header.page_bytes, header.extent);
+        return {Computer(std::move(program), header.pc, header.relative_base, header.halted), pending};
+    }
+
+    /**
+     * Turns on memoization of calls made through the relative-base calling
+     * convention (see CallMemo).
+     */
+    void memoize() {
+        memo = std::make_unique<CallMemo>();
+    }
+    /**
+     * Turns on the code cache laid out by `profile` (see CodeCache). With
+     * `train`, executions are counted per instruction for the next profile.
+     */
+    void use_cache(Profile profile, bool train) {
+        cache = std::make_unique<CodeCache>(std::move(profile), train);
+    }
+    const CodeCache *cache_stats() const {
+        return cache.get();
+    }
+    bool is_halted() const {
+        return halted;
+    }
+    /**
+     * Writes the machine state as text: pc, relative base and halted, then
+     * "address value" for every non-zero word of memory in address order.
+     */
+    void dump(const std::string &path) const {
+        std::size_t page_words = sysconf(_SC_PAGESIZE) / sizeof(code);
+        std::ofstream file(path, std::ios::trunc);
+        file << std::format("pc {}\nrelative_base {}\nhalted {}\n", pc, relative_base, halted ? 1 : 0);
+        for (auto page : touched_pages(p, page_words)) {
+            auto words = p.data() + page * page_words;
+            for (std::size_t i = 0; i < page_words; i++)
+                if (words[i] != 0)
+                    file << page * page_words + i << ' ' << words[i] << '\n';
+        }
+        if (!file.flush())
+            throw std::runtime_error(std::format("cannot write {}", path));
+    }
+    const CallMemo *memo_stats() const {
+        return memo.get();
+    }
+    /**
+     * Makes run return Stop::step_limit once `steps` instructions have been
+     * executed in all. A replayed call counts as every instruction it stands
+     * for, so the stop can come later than asked; steps() says where.
+     */
+    void limit_steps(uint64_t steps) {
+        step_limit = steps;
+    }
+    uint64_t steps() const {
+        return executed;
+    }
+
+    /**
+     * Executes until the program halts, needs an input that `input` cannot
+     * supply, or `output` reaches `output_limit` values. Consumed inputs are
+     * popped and outputs are appended, so the caller can drain both between
+     * calls and keep memory bounded however long the program runs.
+     */
+    Stop run(std::deque<code> &input, std::vector<code> &output, std::size_t output_limit) {
+        assert(!halted);
+
+        auto limited = step_limit != UINT64_MAX;
+        if (cache) {
+            std::optional<Stop> stop{};
+            if (cache->train)
+                stop = limited ? run_cached<true, true>(input, output, output_limit) : run_cached<true, false>(input, output, output_limit);
+            else
+                stop = limited ? run_cached<false, true>(input, output, output_limit) : run_cached<false, false>(input, output, output_limit);
+            if (stop)
+                return *stop;
+        }
+        if (memo)
+            return limited ? run_loop<true, true>(input, output, output_limit) : run_loop<true, false>(input, output, output_limit);
+        return limited ? run_loop<false, true>(input, output, output_limit) : run_loop<false, false>(input, output, output_limit);
+    }
+};
+
+const std::size_t IO_BUFFER = 1 << 20;
+// How many values are handed to the VM per refill, and how many it may emit
+// before control comes back to flush them.
+const std::size_t IO_BATCH = 1 << 12;
+
+/**
+ * Reads stdin in large blocks and turns it into VM inputs: in numeric mode a
+ * stream of integers separated by anything that is not a digit or '-', in
+ * ASCII mode one input per byte.
+ */
+class InputStream {
+  private:
+    std::vector<char> buffer = std::vector<char>(IO_BUFFER);
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    bool eof = false;
+    // A number split across two reads is carried over here.
+    code partial = 0;
+    bool in_number = false;
+    bool negative = false;
+
+    bool refill() {
+        if (eof)
+            return false;
+        ssize_t n;
+        do {
+            n = read(STDIN_FILENO, buffer.data(), buffer.size());
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+            throw std::system_error(errno, std::generic_category(), "reading stdin");
+        begin = 0;
+        end = n;
+        eof = n == 0;
+        return !eof;
+    }
+
+  public:
+    bool ascii;
+    InputStream(bool ascii) : ascii(ascii) {};
+
+    /**
+     * Appends up to `limit` inputs, reading stdin only when the buffer is
+     * exhausted and nothing has been added yet: a read may block, so the
+     * values at hand go to the program first. Returns false once stdin is at
+     * EOF and nothing was added.
+     */
+    bool fill(std::deque<code> &input, std::size_t limit) {
+        std::size_t added = 0;
+        while (added < limit) {
+            if (begin == end && (added > 0 || !refill()))
+                break;
+            if (ascii) {
+                for (; begin < end && added < limit; begin++, added++)
+                    input.push_back(static_cast<unsigned char>(buffer[begin]));
+                continue;
+            }
+            for (; begin < end && added < limit; begin++) {
+                auto c = buffer[begin];
+                if (c >= '0' && c <= '9') {
+                    partial = partial * 10 + (c - '0');
+                    in_number = true;
+                } else if (c == '-' && !in_number) {
+                    negative = true;
+                } else {
+                    if (in_number) {
+                        input.push_back(negative ? -partial : partial);
+                        added++;
+                    }
+                    partial = 0;
+                    in_number = negative = false;
+                }
+            }
+        }
+        if (eof && in_number) {
+            input.push_back(negative ? -partial : partial);
+            added++;
+            partial = 0;
+            in_number = negative = false;
+        }
+        return added > 0;
+    }
+};
+
+/**
+ * Buffers VM outputs and writes them to stdout in large blocks. Numeric mode
+ * writes one value per line; ASCII mode writes values below 128 as bytes and
+ * anything else as a number on its own line.
+ */
+class OutputStream {
+  private:
+    std::vector<char> buffer = std::vector<char>(IO_BUFFER);
+    std::size_t size = 0;
+
+  public:
+    bool ascii;
+    OutputStream(bool ascii) : ascii(ascii) {};
+    ~OutputStream() {
+        flush();
+    }
+
+    void write(const std::vector<code> &output) {
+        for (auto x : output) {
+            // Longest line is "-9223372036854775808\n".
+            if (size + 24 > buffer.size())
+                flush();
+            if (ascii && x >= 0 && x < 128) {
+                buffer[size++] = static_cast<char>(x);
+                continue;
+            }
+            auto [ptr, _] = std::to_chars(&buffer[size], &buffer[buffer.size()], x);
+            size = ptr - buffer.data();
+            buffer[size++] = '\n';
+        }
+    }
+    void flush() {
+        for (std::size_t done = 0; done < size;) {
+            auto n = ::write(STDOUT_FILENO, buffer.data() + done, size - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw std::system_error(errno, std::generic_category(), "writing stdout");
+            done += n;
+        }
+        size = 0;
+    }
+};
+
+/**
+ * Usage: runner [--ascii] [--memoize | [--profile PROFILE] [--profile-out PROFILE]] [--dump-memory DUMP] [--steps N] PROGRAM
+ *        runner --save-snapshot IMAGE PROGRAM
+ *        runner [--ascii] [--memoize | [--profile PROFILE] [--profile-out PROFILE]] [--dump-memory DUMP] [--steps N] --snapshot IMAGE
+ *
+ * Runs an Intcode program as a pipe filter: stdin feeds the program's inputs
+ * and its outputs are written to stdout. Memory use stays constant however
+ * long the input stream is. --memoize caches pure calls; cache statistics go
+ * to stderr at exit.
+ *
+ * --save-snapshot runs PROGRAM up to its first input instruction and saves the
+ * state as IMAGE instead of streaming; --snapshot then starts from IMAGE, so
+ * the initialization is not executed again.
+ *
+ * --profile-out runs from the code cache and writes how often each instruction
+ * ran to PROFILE at exit. --profile lays the code cache out by such a profile
+ * from a training run, so hot paths are contiguous. A cache summary goes to
+ * stderr at exit.
+ *
+ * --dump-memory writes the final machine state to DUMP when the program halts,
+ * runs out of input or fails, for comparing engines (see fuzz.cpp); after a
+ * failure pc is the instruction that failed. --steps stops the program once N
+ * instructions have executed, reporting the count on stderr, so that a state
+ * that differs between engines can be narrowed down to one instruction.
+ */
+int main(int argc, char **argv) {
+    bool ascii = false;
+    bool memoize = false;
+    std::string path{};
+    std::string save_path{};
+    std::string snapshot_path{};
+    std::string profile_path{};
+    std::string profile_out{};
+    std::string dump_path{};
+    std::optional<uint64_t> steps{};
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--ascii") {
+            ascii = true;
+        } else if (arg == "--memoize") {
+            memoize = true;
+        } else if (arg == "--save-snapshot" && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (arg == "--snapshot" && i + 1 < argc) {
+            snapshot_path = argv[++i];
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_path = argv[++i];
+        } else if (arg == "--profile-out" && i + 1 < argc) {
+            profile_out = argv[++i];
+        } else if (arg == "--dump-memory" && i + 1 < argc) {
+            dump_path = argv[++i];
+        } else if (arg == "--steps" && i + 1 < argc) {
+            steps = std::stoull(argv[++i]);
+        } else if (path.empty() && !arg.starts_with("--")) {
+            path = arg;
+        } else {
+            std::cerr << std::format("unknown argument {}", arg) << std::endl;
+            return 2;
+        }
+    }
+    auto cached = !profile_path.empty() || !profile_out.empty();
+    if (path.empty() == snapshot_path.empty() || (!save_path.empty() && !snapshot_path.empty()) || (memoize && cached)) {
+        std::cerr << "usage: runner [--ascii] [--memoize | [--profile PROFILE] [--profile-out PROFILE]] [--dump-memory DUMP] [--steps N] PROGRAM\n"
+                     "       runner --save-snapshot IMAGE PROGRAM\n"
+                     "       runner [--ascii] [--memoize | [--profile PROFILE] [--profile-out PROFILE]] [--dump-memory DUMP] [--steps N] --snapshot IMAGE"
+                  << std::endl;
+        return 2;
+    }
+
+    std::optional<Computer> computer{};
+    std::vector<code> output{};
+    try {
+        if (!snapshot_path.empty()) {
+            auto [restored, pending] = Computer::restore(snapshot_path);
+            computer.emplace(std::move(restored));
+            output = std::move(pending);
+        } else {
+            std::ifstream program_file(path);
+            if (!program_file) {
+                std::cerr << std::format("cannot open {}", path) << std::endl;
+                return 2;
+            }
+            computer.emplace(Program::parse(program_file));
+        }
+        if (!save_path.empty()) {
+            std::deque<code> none{};
+            computer->run(none, output, SIZE_MAX);
+            computer->save(save_path, output);
+            return 0;
+        }
+        if (cached)
+            computer->use_cache(profile_path.empty() ? Profile{} : CodeCache::read_profile(profile_path), !profile_out.empty());
+    } catch (std::exception &e) {
+        std::cerr << std::format("runner: {}", e.what()) << std::endl;
+        return 1;
+    }
+
+    if (memoize)
+        computer->memoize();
+    if (steps)
+        computer->limit_steps(*steps);
+    InputStream in(ascii);
+    OutputStream out(ascii);
+    std::deque<code> input{};
+    output.reserve(IO_BATCH);
+
+    int status = 0;
+    try {
+        out.write(output);
+        output.clear();
+        while (!computer->is_halted()) {
+            auto stop = computer->run(input, output, IO_BATCH);
+            out.write(output);
+            output.clear();
+            if (stop == Stop::halted)
+                break;
+            if (stop == Stop::step_limit) {
+                std::cerr << std::format("runner: stopped after {} instructions", computer->steps()) << std::endl;
+                break;
+            }
+            if (stop == Stop::needs_input) {
+                // Anything already produced must reach a reader that is
+                // waiting on it before we block on the next read.
+                out.flush();
+                // A program still waiting for input at EOF has consumed the
+                // whole stream, which is the normal end of a filter.
+                if (!in.fill(input, IO_BATCH))
+                    break;
+            }
+        }
+    } catch (std::exception &e) {
+        // Outputs from before the error still belong to the stream.
+        out.write(output);
+        out.flush();
+        std::cerr << std::format("runner: {}", e.what()) << std::endl;
+        status = 1;
+    }
+    if (!dump_path.empty()) {
+        try {
+            computer->dump(dump_path);
+        } catch (std::exception &e) {
+            std::cerr << std::format("runner: {}", e.what()) << std::endl;
+            status = 1;
+        }
+    }
+    if (auto stats = computer->memo_stats())
+        std::cerr << std::format("memo: {} hits, {} misses, {} flushes", stats->hits, stats->misses, stats->flushes) << std::endl;
+    if (auto stats = computer->cache_stats()) {
+        std::cerr << std::format("cache: {} ops in {} blocks, {} invalidations", stats->ops.size(), stats->block_count, stats->invalidations) << std::endl;
+        if (!profile_out.empty()) {
+            try {
+                CodeCache::write_profile(profile_out, stats->collected());
+            } catch (std::exception &e) {
+                std::cerr << std::format("runner: {}", e.what()) << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    return status;
+}
@@ -11,11 +11,18 @@ void vector_init(Vector &v, int s) {
     v.sz = s;
 }
 
+void vector_destroy(Vector &v) {
+    delete[] v.elem;
+    v.elem = nullptr;
+    v.sz = 0;
+}
+
 int main() {
     Vector v;
     vector_init(v, 1);
 
     cout << "v.sz=" << v.sz << endl;
 
+    vector_destroy(v);
     return 0;
 }
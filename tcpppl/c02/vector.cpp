@@ -1,19 +1,586 @@
-class Vector {
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Allocates storage aligned to `Align` bytes, so that SIMD loads of whole
+ * vectors never straddle a cache line at the start.
+ */
+template <typename T, std::size_t Align = 64> struct AlignedAllocator {
+    typedef T value_type;
+    template <typename U> struct rebind {
+        typedef AlignedAllocator<U, Align> other;
+    };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Align> &) noexcept {
+    }
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{Align}));
+    }
+    void deallocate(T *p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t{Align});
+    }
+    template <typename U> bool operator==(const AlignedAllocator<U, Align> &) const noexcept {
+        return true;
+    }
+};
+
+// The load<V>() members return SIMD values from functions built without AVX.
+// They are always inlined into the target("avx...") kernels below, so the ABI
+// change GCC warns about never reaches a real call.
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+template <typename Allocator> class Vector;
+
+template <typename T> struct is_vector : std::false_type {};
+template <typename A> struct is_vector<Vector<A>> : std::true_type {};
+// Specialized for each expression node type below.
+template <typename T> struct is_node : std::false_type {};
+
+// An unevaluated expression, as built by the operators further down.
+template <typename T> concept Node = is_node<std::remove_cvref_t<T>>::value;
+// Anything that can be an operand: a Vector or an expression.
+template <typename T> concept Expression = Node<T> || is_vector<std::remove_cvref_t<T>>::value;
+
+/**
+ * A growable array of doubles that owns its elements. Up to INLINE elements
+ * live in a buffer inside the object, so short vectors never touch the heap.
+ * Longer ones use `Allocator`, which is 64-byte aligned by default. Capacity
+ * doubles on growth. Moving is noexcept: it steals the heap buffer, or copies
+ * the few inline elements.
+ */
+template <typename Allocator = AlignedAllocator<double>> class Vector {
   public:
-    Vector(int s) : elem{new double[s]}, sz{s} {
+    static constexpr std::size_t INLINE = 8;
+
+    Vector() noexcept(noexcept(Allocator())) : Vector(Allocator()) {
+    }
+    explicit Vector(const Allocator &alloc) noexcept : alloc{alloc} {
+    }
+    explicit Vector(std::size_t s, const Allocator &alloc = Allocator()) : alloc{alloc} {
+        reserve(s);
+        std::fill_n(elem, s, 0.0);
+        sz = s;
     }
-    double &operator[](int i) {
+    Vector(std::initializer_list<double> list, const Allocator &alloc = Allocator()) : alloc{alloc} {
+        reserve(list.size());
+        std::copy(list.begin(), list.end(), elem);
+        sz = list.size();
+    }
+    /**
+     * Evaluates `e` in a single pass, with no temporaries.
+     */
+    template <Node E> Vector(const E &e, const Allocator &alloc = Allocator()) : alloc{alloc} {
+        assign(e);
+    }
+    Vector(const Vector &other) : alloc{Traits::select_on_container_copy_construction(other.alloc)} {
+        reserve(other.sz);
+        std::copy_n(other.elem, other.sz, elem);
+        sz = other.sz;
+    }
+    Vector(Vector &&other) noexcept : alloc{std::move(other.alloc)} {
+        steal(other);
+    }
+    Vector &operator=(const Vector &other) {
+        if (this == &other)
+            return *this;
+        if constexpr (Traits::propagate_on_container_copy_assignment::value) {
+            if (alloc != other.alloc) {
+                release();
+                alloc = other.alloc;
+            }
+        }
+        sz = 0;
+        reserve(other.sz);
+        std::copy_n(other.elem, other.sz, elem);
+        sz = other.sz;
+        return *this;
+    }
+    Vector &operator=(Vector &&other) noexcept(Traits::propagate_on_container_move_assignment::value || Traits::is_always_equal::value) {
+        if (this == &other)
+            return *this;
+        if constexpr (Traits::propagate_on_container_move_assignment::value) {
+            release();
+            alloc = std::move(other.alloc);
+        } else if (alloc != other.alloc) {
+            // Memory from another allocator cannot be adopted, only copied.
+            return *this = static_cast<const Vector &>(other);
+        } else {
+            release();
+        }
+        steal(other);
+        return *this;
+    }
+    template <Node E> Vector &operator=(const E &e) {
+        assign(e);
+        return *this;
+    }
+    ~Vector() {
+        release();
+    }
+
+    double &operator[](std::size_t i) {
+        return elem[i];
+    }
+    const double &operator[](std::size_t i) const {
         return elem[i];
     }
-    int size() {
+    std::size_t size() const {
         return sz;
     }
+    std::size_t capacity() const {
+        return cap;
+    }
+    bool is_inline() const {
+        return elem == buffer;
+    }
+    /**
+     * The elements from `i` as one SIMD value of type V, or one double.
+     */
+    template <typename V> [[gnu::always_inline]] V load(std::size_t i) const {
+        V v;
+        std::memcpy(&v, elem + i, sizeof(V));
+        return v;
+    }
+    double *data() {
+        return elem;
+    }
+    const double *data() const {
+        return elem;
+    }
+    double *begin() {
+        return elem;
+    }
+    double *end() {
+        return elem + sz;
+    }
+    const double *begin() const {
+        return elem;
+    }
+    const double *end() const {
+        return elem + sz;
+    }
+
+    void reserve(std::size_t n) {
+        if (n <= cap)
+            return;
+        auto grown = Traits::allocate(alloc, n);
+        std::copy_n(elem, sz, grown);
+        release();
+        elem = grown;
+        cap = n;
+    }
+    void push_back(double x) {
+        if (sz == cap)
+            reserve(cap * 2);
+        elem[sz++] = x;
+    }
+    void resize(std::size_t n) {
+        reserve(n);
+        if (n > sz)
+            std::fill(elem + sz, elem + n, 0.0);
+        sz = n;
+    }
+    void clear() {
+        sz = 0;
+    }
 
   private:
-    double *elem;
-    int sz;
+    typedef std::allocator_traits<Allocator> Traits;
+
+    double *elem = buffer;
+    std::size_t sz = 0;
+    std::size_t cap = INLINE;
+    [[no_unique_address]] Allocator alloc;
+    alignas(64) double buffer[INLINE];
+
+    template <typename E> void assign(const E &e);
+    void release() noexcept {
+        if (!is_inline())
+            Traits::deallocate(alloc, elem, cap);
+        elem = buffer;
+        cap = INLINE;
+    }
+    // Takes other's elements, leaving it empty. Both must use equal allocators.
+    void steal(Vector &other) noexcept {
+        if (other.is_inline()) {
+            std::copy_n(other.buffer, other.sz, buffer);
+            elem = buffer;
+            cap = INLINE;
+        } else {
+            elem = other.elem;
+            cap = other.cap;
+        }
+        sz = other.sz;
+        other.elem = other.buffer;
+        other.cap = INLINE;
+        other.sz = 0;
+    }
+};
+
+/**
+ * A constant operand, broadcast to every lane: `2.0 * v`.
+ */
+struct Scalar {
+    double value;
+
+    double operator[](std::size_t) const {
+        return value;
+    }
+    template <typename V> [[gnu::always_inline]] V load(std::size_t) const {
+        return V{} + value;
+    }
+};
+
+// Expression nodes hold Vectors by reference and everything else by value, so
+// an expression must be used before the Vectors it names go away.
+template <typename T> using Stored = std::conditional_t<is_vector<T>::value, const T &, T>;
+
+template <typename L, typename R, typename Op> struct Binary {
+    Stored<L> l;
+    Stored<R> r;
+
+    std::size_t size() const {
+        if constexpr (std::is_same_v<L, Scalar>)
+            return r.size();
+        else
+            return l.size();
+    }
+    double operator[](std::size_t i) const {
+        return Op::apply(l[i], r[i]);
+    }
+    template <typename V> [[gnu::always_inline]] V load(std::size_t i) const {
+        return Op::apply(l.template load<V>(i), r.template load<V>(i));
+    }
+};
+
+template <typename E, typename Op> struct Unary {
+    Stored<E> e;
+
+    std::size_t size() const {
+        return e.size();
+    }
+    double operator[](std::size_t i) const {
+        return Op::apply(e[i]);
+    }
+    template <typename V> [[gnu::always_inline]] V load(std::size_t i) const {
+        return Op::apply(e.template load<V>(i));
+    }
+};
+
+template <typename L, typename R, typename Op> struct is_node<Binary<L, R, Op>> : std::true_type {};
+template <typename E, typename Op> struct is_node<Unary<E, Op>> : std::true_type {};
+
+// Each op works on a double and on a SIMD value alike.
+struct Add {
+    template <typename T> [[gnu::always_inline]] static T apply(const T &a, const T &b) {
+        return a + b;
+    }
+};
+struct Sub {
+    template <typename T> [[gnu::always_inline]] static T apply(const T &a, const T &b) {
+        return a - b;
+    }
+};
+struct Mul {
+    template <typename T> [[gnu::always_inline]] static T apply(const T &a, const T &b) {
+        return a * b;
+    }
+};
+struct Negate {
+    template <typename T> [[gnu::always_inline]] static T apply(const T &a) {
+        return -a;
+    }
+};
+struct Square {
+    template <typename T> [[gnu::always_inline]] static T apply(const T &a) {
+        return a * a;
+    }
 };
 
-int main() {
+template <typename Op, Expression L, Expression R> Binary<L, R, Op> binary(const L &l, const R &r) {
+    assert(l.size() == r.size());
+    return {l, r};
+}
+template <Expression L, Expression R> auto operator+(const L &l, const R &r) {
+    return binary<Add>(l, r);
+}
+template <Expression L, Expression R> auto operator-(const L &l, const R &r) {
+    return binary<Sub>(l, r);
+}
+template <Expression L, Expression R> auto operator*(const L &l, const R &r) {
+    return binary<Mul>(l, r);
+}
+template <Expression E> auto operator*(double s, const E &e) {
+    return Binary<Scalar, E, Mul>{Scalar{s}, e};
+}
+template <Expression E> auto operator*(const E &e, double s) {
+    return Binary<E, Scalar, Mul>{e, Scalar{s}};
+}
+template <Expression E> auto operator+(const E &e, double s) {
+    return Binary<E, Scalar, Add>{e, Scalar{s}};
+}
+template <Expression E> auto operator-(const E &e) {
+    return Unary<E, Negate>{e};
+}
+template <Expression E> auto square(const E &e) {
+    return Unary<E, Square>{e};
+}
+
+typedef double Lanes4 __attribute__((vector_size(32)));
+typedef double Lanes8 __attribute__((vector_size(64)));
+
+/**
+ * Which kernels evaluate expressions: plain doubles, 4-lane AVX2 or 8-lane
+ * AVX-512. Every expression is compiled once per kernel and the one to use is
+ * picked at run time, so one binary runs everywhere.
+ */
+enum class Isa { scalar, avx2, avx512 };
+
+Isa detect_isa() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return Isa::avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return Isa::avx2;
+    return Isa::scalar;
+}
+
+// Detected once; the benchmark lowers it to compare kernels.
+Isa active_isa = detect_isa();
+
+template <typename V, typename E> [[gnu::always_inline]] inline void evaluate_with(double *dst, const E &e, std::size_t n) {
+    constexpr std::size_t W = sizeof(V) / sizeof(double);
+    std::size_t i = 0;
+    for (; i + W <= n; i += W) {
+        V v = e.template load<V>(i);
+        std::memcpy(dst + i, &v, sizeof(V));
+    }
+    for (; i < n; i++)
+        dst[i] = e[i];
+}
+
+/**
+ * Sums the expression with four independent accumulators, so the adds are
+ * not serialized on their latency.
+ */
+template <typename V, typename E> [[gnu::always_inline]] inline double sum_with(const E &e, std::size_t n) {
+    constexpr std::size_t W = sizeof(V) / sizeof(double);
+    V acc[4]{};
+    std::size_t i = 0;
+    for (; i + 4 * W <= n; i += 4 * W)
+        for (std::size_t k = 0; k < 4; k++)
+            acc[k] += e.template load<V>(i + k * W);
+    for (; i + W <= n; i += W)
+        acc[0] += e.template load<V>(i);
+    V total = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    double s = 0;
+    if constexpr (W == 1) {
+        s = total;
+    } else {
+        for (std::size_t k = 0; k < W; k++)
+            s += total[k];
+    }
+    for (; i < n; i++)
+        s += e[i];
+    return s;
+}
+
+template <typename E> [[gnu::target("avx512f")]] void evaluate_avx512(double *dst, const E &e, std::size_t n) {
+    evaluate_with<Lanes8>(dst, e, n);
+}
+template <typename E> [[gnu::target("avx2,fma")]] void evaluate_avx2(double *dst, const E &e, std::size_t n) {
+    evaluate_with<Lanes4>(dst, e, n);
+}
+template <typename E> [[gnu::target("avx512f")]] double sum_avx512(const E &e, std::size_t n) {
+    return sum_with<Lanes8>(e, n);
+}
+template <typename E> [[gnu::target("avx2,fma")]] double sum_avx2(const E &e, std::size_t n) {
+    return sum_with<Lanes4>(e, n);
+}
+
+/**
+ * Writes the `n` elements of `e` to `dst` in one pass. `dst` may be one of the
+ * Vectors in `e`, since element i only depends on operands' element i.
+ */
+template <typename E> void evaluate(double *dst, const E &e, std::size_t n) {
+    switch (active_isa) {
+        case Isa::avx512:
+            return evaluate_avx512(dst, e, n);
+        case Isa::avx2:
+            return evaluate_avx2(dst, e, n);
+        default:
+            return evaluate_with<double>(dst, e, n);
+    }
+}
+
+template <Expression E> double sum(const E &e) {
+    switch (active_isa) {
+        case Isa::avx512:
+            return sum_avx512(e, e.size());
+        case Isa::avx2:
+            return sum_avx2(e, e.size());
+        default:
+            return sum_with<double>(e, e.size());
+    }
+}
+template <Expression L, Expression R> double dot(const L &l, const R &r) {
+    return sum(l * r);
+}
+template <Expression E> double norm(const E &e) {
+    return std::sqrt(sum(square(e)));
+}
+
+template <typename Allocator> template <typename E> void Vector<Allocator>::assign(const E &e) {
+    auto n = e.size();
+    // Growing here would move a Vector that `e` may still read; only an empty
+    // or differently sized target can need it, and then it is not an operand.
+    reserve(n);
+    evaluate(elem, e, n);
+    sz = n;
+}
+
+/**
+ * Times `body` over `rounds` rounds of `n` elements and prints the time per
+ * element. `body` returns a checksum so the work can't be optimized away.
+ */
+template <typename Body> double bench(const std::string &name, std::size_t n, std::size_t rounds, Body body) {
+    double checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t r = 0; r < rounds; r++)
+        checksum += body();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::format("{:<28} {:>10} {:>10.3f} ns/elem", name, n, elapsed.count() / (n * rounds)) << std::endl;
+    return checksum;
+}
+
+/**
+ * Push, iterate and copy throughput against std::vector<double>, for short
+ * vectors (which stay inline) and long ones.
+ */
+template <typename V> double bench_suite(const std::string &name) {
+    double checksum = 0;
+    for (std::size_t n : {4, 1 << 20}) {
+        auto rounds = (std::size_t{1} << 24) / n;
+        checksum += bench(name + " push_back", n, rounds, [n] {
+            V v;
+            for (std::size_t i = 0; i < n; i++)
+                v.push_back(i);
+            return v[n - 1];
+        });
+        V filled;
+        for (std::size_t i = 0; i < n; i++)
+            filled.push_back(i);
+        checksum += bench(name + " iterate", n, rounds, [&filled] {
+            double sum = 0;
+            for (auto x : filled)
+                sum += x;
+            return sum;
+        });
+        checksum += bench(name + " copy", n, rounds, [&filled, n] {
+            V copy = filled;
+            return copy[n - 1];
+        });
+    }
+    return checksum;
+}
+
+/**
+ * Throughput of fused expressions on vectors far larger than the caches, for
+ * each kernel the CPU supports, next to plain copying as the memory-bandwidth
+ * ceiling. `a = b + c * d` is also timed with one temporary per operator, as
+ * it would run without expression templates.
+ */
+double bench_expressions() {
+    const std::size_t n = std::size_t{1} << 23;
+    const std::size_t rounds = 5;
+    Vector<> a(n), b(n), c(n), d(n);
+    for (std::size_t i = 0; i < n; i++) {
+        b[i] = i * 0.5;
+        c[i] = 1.0 / (i + 1);
+        d[i] = 3.0;
+    }
+
+    double checksum = 0;
+    auto gbps = [&](const std::string &name, std::size_t bytes_per_element, auto body) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t r = 0; r < rounds; r++)
+            checksum += body();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << std::format("{:<28} {:>10.2f} GB/s", name, bytes_per_element * n * rounds / elapsed.count() / 1e9) << std::endl;
+    };
+
+    gbps("copy", 16, [&] {
+        std::copy(b.begin(), b.end(), a.begin());
+        return a[n - 1];
+    });
+    gbps("a = b + c * d (temporaries)", 56, [&] {
+        Vector<> t(n);
+        for (std::size_t i = 0; i < n; i++)
+            t[i] = c[i] * d[i];
+        for (std::size_t i = 0; i < n; i++)
+            a[i] = b[i] + t[i];
+        return a[n - 1];
+    });
+
+    auto best = active_isa;
+    for (auto isa : {Isa::scalar, Isa::avx2, Isa::avx512}) {
+        if (isa > best)
+            break;
+        active_isa = isa;
+        std::string name = isa == Isa::avx512 ? "avx512" : isa == Isa::avx2 ? "avx2" : "scalar";
+        gbps(name + " a = b + c * d", 32, [&] {
+            a = b + c * d;
+            return a[n - 1];
+        });
+        gbps(name + " a = 2 * b", 16, [&] {
+            a = 2.0 * b;
+            return a[n - 1];
+        });
+        gbps(name + " a = square(b)", 16, [&] {
+            a = square(b);
+            return a[n - 1];
+        });
+        gbps(name + " dot(b, c)", 16, [&] { return dot(b, c); });
+        gbps(name + " norm(b)", 8, [&] { return norm(b); });
+    }
+    active_isa = best;
+    return checksum;
+}
+
+/**
+ * Usage: vector [--bench]
+ *
+ * --bench also runs the benchmarks, which take several seconds.
+ */
+int main(int argc, char **argv) {
+    Vector<> v{1, 2, 3};
+    v.push_back(4);
+    auto moved = std::move(v);
+    Vector<> w = 2.0 * moved + square(moved);
+    std::cout << std::format("w[3]={} dot={} norm={}", w[3], dot(w, moved), norm(moved)) << std::endl;
+    std::cout << std::format("moved.size()={} inline={} v.size()={}", moved.size(), moved.is_inline(), v.size()) << std::endl;
+
+    if (argc < 2 || std::string_view(argv[1]) != "--bench")
+        return 0;
+    double checksum = bench_suite<Vector<>>("Vector");
+    checksum += bench_suite<std::vector<double>>("std::vector");
+    checksum += bench_expressions();
+    std::cout << std::format("checksum={}", checksum) << std::endl;
     return 0;
 }